@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Cache line aligned weight storage with optional 2 MB huge pages.
+ * Every block starts on a 64 byte boundary, so a window of up to 16 floats that starts on a line
+ * stays in one line and SIMD loads never split a line. Large tables can additionally be backed
+ * by huge pages, which cuts TLB misses when queries jump across a table of many megabytes:
+ * HUGE_PAGES_ADVISE asks for transparent huge pages with madvise(MADV_HUGEPAGE) and
+ * HUGE_PAGES_HUGETLB maps the reserved hugetlbfs pool (MAP_HUGETLB), falling back to advised
+ * pages when the pool is empty. Without Linux both modes behave like HUGE_PAGES_OFF.
+ */
+
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+#include <type_traits>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/**
+ * @brief Page backing of aligned blocks of at least huge_page_size bytes
+ */
+enum HugePages
+{
+    HUGE_PAGES_OFF = 0,         // Regular pages
+    HUGE_PAGES_ADVISE,          // 2 MB aligned, madvise(MADV_HUGEPAGE)
+    HUGE_PAGES_HUGETLB          // mmap(MAP_HUGETLB), advised regular pages if that fails
+};
+
+constexpr size_t cache_line_size = 64;
+constexpr size_t huge_page_size = size_t(2) << 20;
+
+void* allocateAligned(size_t bytes, HugePages huge_pages);
+void freeAligned(void* block, size_t bytes, HugePages huge_pages);
+const char* hugePagesName(HugePages huge_pages);
+
+/**
+ * @brief Aligned Allocator Class
+ * Standard allocator handing out cache line aligned blocks; the huge page mode is part of its
+ * state and travels with the container on copy, move and swap.
+ */
+template <typename T>
+class AlignedAllocator
+{
+private:
+    HugePages huge_pages;
+
+    template <typename U> friend class AlignedAllocator;
+
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    AlignedAllocator(HugePages huge_pages = HUGE_PAGES_OFF) : huge_pages(huge_pages) {};
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>& other) : huge_pages(other.huge_pages) {};
+
+    HugePages getHugePages() const { return huge_pages; }
+    T* allocate(size_t n) { return (T*)allocateAligned(n * sizeof(T), huge_pages); }
+    void deallocate(T* block, size_t n) { freeAligned(block, n * sizeof(T), huge_pages); }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>& other) const { return huge_pages == other.huge_pages; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>& other) const { return huge_pages != other.huge_pages; }
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Allocate a cache line aligned block
+ * Blocks smaller than a huge page always use regular pages, so freeAligned can tell the two
+ * kinds apart from the size alone.
+ *
+ * @param bytes Block size
+ * @param huge_pages Page backing for blocks of at least huge_page_size bytes
+ * @return Block, throws std::bad_alloc on failure
+ */
+void* allocateAligned(size_t bytes, HugePages huge_pages)
+{
+#ifdef __linux__
+    if (huge_pages != HUGE_PAGES_OFF && bytes >= huge_page_size)
+    {
+        size_t rounded = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void* block = nullptr;
+        if (huge_pages == HUGE_PAGES_HUGETLB)
+        {
+            block = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (block != MAP_FAILED)
+                return block;
+            block = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (block == MAP_FAILED)
+                throw std::bad_alloc();
+        }
+        else if (posix_memalign(&block, huge_page_size, rounded) != 0)
+            throw std::bad_alloc();
+        madvise(block, rounded, MADV_HUGEPAGE);
+        return block;
+    }
+#endif
+    // posix_memalign (_aligned_malloc on Windows) instead of aligned operator new, which needs C++17
+    void* block = nullptr;
+#ifdef _WIN32
+    block = _aligned_malloc(bytes ? bytes : 1, cache_line_size);
+    if (!block)
+        throw std::bad_alloc();
+#else
+    if (posix_memalign(&block, cache_line_size, bytes ? bytes : 1) != 0)
+        throw std::bad_alloc();
+#endif
+    return block;
+}
+
+/**
+ * @brief Free a block of allocateAligned
+ *
+ * @param block Block
+ * @param bytes Size passed to allocateAligned
+ * @param huge_pages Mode passed to allocateAligned
+ */
+void freeAligned(void* block, size_t bytes, HugePages huge_pages)
+{
+#ifdef __linux__
+    if (huge_pages != HUGE_PAGES_OFF && bytes >= huge_page_size)
+    {
+        if (huge_pages == HUGE_PAGES_HUGETLB)
+            munmap(block, (bytes + huge_page_size - 1) / huge_page_size * huge_page_size);
+        else
+            free(block);
+        return;
+    }
+#endif
+#ifdef _WIN32
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
+/**
+ * @brief Name of a huge page mode
+ * @param huge_pages Mode
+ * @return "off", "advise" or "hugetlb"
+ */
+const char* hugePagesName(HugePages huge_pages)
+{
+    switch (huge_pages)
+    {
+    case HUGE_PAGES_ADVISE: return "advise";
+    case HUGE_PAGES_HUGETLB: return "hugetlb";
+    default: return "off";
+    }
+}
@@ -28,8 +28,82 @@
 #include <math.h>
 #include <vector>
 #include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include "telemetry.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "metrics.h"
+#include "error_metrics.h"
+#include "lr_schedule.h"
+#include "shuffle.h"
+#include "aligned_allocator.h"
 # define PI 3.141592  // pi 
 
+/**
+ * @brief How the error of a sample is distributed over its active weights
+ */
+enum UpdateMode
+{
+    UPDATE_UNIFORM = 0,         // Equal share lr * error / gen_factor for every active cell
+    UPDATE_CREDIT,              // Shares proportional to the inverse visit count of each cell (credit assignment)
+    UPDATE_ADAGRAD,             // Per cell step lr / sqrt(sum of squared errors)
+    UPDATE_RMSPROP              // Per cell step lr / sqrt(decayed mean of squared errors)
+};
+
+/**
+ * @brief Initial weights set by beginTraining
+ */
+enum WeightInit
+{
+    INIT_ONES = 0,              // Every weight 1 (the constructor default)
+    INIT_ZEROS,                 // Every weight 0
+    INIT_TARGET_MEAN,           // Every window predicts the mean target
+    INIT_LOCAL_AVERAGE          // Every cell starts at the mean target of the samples activating it
+};
+
+/**
+ * @brief Order in which the samples are visited by every training epoch
+ */
+enum ShuffleMode
+{
+    SHUFFLE_NONE = 0,           // Dataset order every epoch
+    SHUFFLE_EPOCH,              // New random permutation every epoch
+    SHUFFLE_BLOCK,              // Samples sorted by association index, random block order and random order inside each block
+    SHUFFLE_SORTED,             // Samples sorted by association index, ascending sweep over the weights every epoch
+    SHUFFLE_BUCKET              // Samples bucketed by the cache line of their first active weight, ascending buckets, random order inside each bucket
+};
+
+/**
+ * @brief Early stopping on a validation set
+ */
+struct EarlyStopping
+{
+    int eval_every = 1;         // Evaluate the validation loss every k epochs
+    int patience = 10;          // Evaluations without improvement before training stops
+    float min_delta = 0;        // Smallest decrease of the validation loss that counts as improvement
+    int max_samples = 0;        // Evaluate an evenly strided subset of at most this many samples (0 = all)
+    bool restore_best = true;   // Restore the weights of the best evaluation when training stops (patience, callback or the end of train)
+};
+
+/**
+ * @brief Cells read by a prediction: count windows of gen_factor cells, each scaled by its share
+ */
+struct ActiveWindows
+{
+    int start[2];               // First cell of each window
+    float share[2];             // Factor applied to the cells of each window
+    int count;                  // 1 (discrete) or 2 (continous)
+};
+
+/**
+ * @brief Weight vector of a model, cache line aligned and optionally huge page backed
+ */
+typedef std::vector<float, AlignedAllocator<float>> WeightVector;
+
 /**
  * @brief Base Cerebellar Motor Articulation Controller (CMAC) Class 
  * A class for building and training the CMAC Neural Network
@@ -39,23 +113,115 @@ class CMAC
 private:
     int gen_factor;
     int num_weights;
-    std::vector<float> wt_vector;
+    WeightVector wt_vector;
     int associated_vec_size;
     std::unordered_map<float, int> association_map;
+    TelemetrySink* telemetry_sink;
+    CMACMetrics* metrics;
+    std::function<bool(int, float)> epoch_callback;
+
+    // Per cell learning rate state, parallel to wt_vector
+    UpdateMode update_mode;
+    float rmsprop_decay;
+    std::vector<float> cell_visits;
+    std::vector<float> cell_accum;
+
+    // Learning rate schedule and the rate used for the last epoch
+    LearningRateSchedule lr_schedule;
+    float curr_lr;
+
+    // Initial weights applied by beginTraining (only once setWeightInit was called)
+    WeightInit weight_init;
+    bool init_on_begin;
+
+    // Sample order of the training epochs (the data itself is never moved)
+    ShuffleMode shuffle_mode;
+    uint64_t shuffle_seed;
+    size_t shuffle_block;
+    std::vector<uint32_t> sorted_order;
+    std::vector<uint32_t> bucket_starts;
+    std::vector<uint32_t> training_order;
+    std::vector<int> sample_cells;
+
+    // Validation driven early stopping (disabled while the validation span is empty)
+    Span<std::pair<float, float>> validation;
+    EarlyStopping early_stopping;
+    std::vector<std::pair<float, float>> validation_predictions;
+    WeightVector best_weights;
+    float best_loss;
+    int best_epoch;
+    int evals_without_improvement;
+
+    // Resumable training state
+    float train_lowerlimit;
+    float train_upperlimit;
+    int epochs_trained;
+    float prev_loss;
+    float curr_loss;
+    bool converged;
+    bool stopped;
+    int64_t training_elapsed_ns;
 
 public:
     CMAC(int gen_factor, int num_weights);
+    virtual ~CMAC() = default;
     void setGenFactor(int genFactor);
-    int getGenFactor();
-    int getAssociatedVecSize();
-    std::vector<float> getWtVector();
+    int getGenFactor() const;
+    int getAssociatedVecSize() const;
+    const WeightVector& getWtVector() const;
     void setWtVector(int start_index, float correction);
+    void releaseWeights();
+    void setHugePages(HugePages huge_pages);
+    HugePages getHugePages() const;
+    void setUpdateMode(UpdateMode mode, float decay);
+    UpdateMode getUpdateMode() const;
+    void resetUpdateState();
+    void applyError(int start_index, float error, float lr);
+    void setLearningRateSchedule(const LearningRateSchedule& schedule);
+    float getLearningRate() const;
+    virtual float getActivationGain() const;
+    void setWeightInit(WeightInit init);
+    void initializeWeights(const std::vector<std::pair<float, float>>& data);
+    bool saveModel(const std::string& path) const;
+    bool loadModel(const std::string& path);
+    void setShuffle(ShuffleMode mode, uint64_t seed, size_t block_size);
+    const std::vector<uint32_t>& getTrainingOrder() const;
+    int getSampleCell(uint32_t sample) const;
+    void setValidation(Span<std::pair<float, float>> validation_data, const EarlyStopping& settings);
+    float getBestLoss() const;
+    int getBestEpoch() const;
+    void restoreBestWeights();
+    float validationLoss();
     int getAssociationMapValue(float key);
     void setAssociationMapValue(float key, int value);
-    float calculateError(std::vector<std::pair<float, float>> data, std::vector<std::pair<float, float>> predicted_data);
-    void generateAssociationMap(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit);
-    virtual void train(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold) = 0;
-    virtual std::vector<std::pair<float, float>> predict(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, float& accuracy, bool train) = 0;
+    void setTelemetrySink(TelemetrySink* sink);
+    TelemetrySink* getTelemetrySink();
+    void setMetrics(CMACMetrics* model_metrics);
+    CMACMetrics* getMetrics() const;
+    int getEpochsTrained() const;
+    float getLoss() const;
+    bool isConverged() const;
+    bool isTrainingFinished() const;
+    int getAssociationIndex(float x, float lowerlimit, float upperlimit) const;
+    float calculateError(Span<std::pair<float, float>> data, Span<std::pair<float, float>> predicted_data) const;
+    void generateAssociationMap(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit);
+    virtual void beginTraining(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit);
+    bool trainEpochs(const std::vector<std::pair<float, float>>& data, int epochs, float lr, float convergenceThreshold);
+    void train(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold);
+    virtual void updatePass(const std::vector<std::pair<float, float>>& data, float lr) = 0;
+    virtual int learnSample(std::pair<float, float> data_element, float lowerlimit, float upperlimit, float lr) = 0;
+    virtual const char* getName() const = 0;
+    virtual std::vector<std::pair<float, float>> predict(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, float& accuracy, bool train) = 0;
+    virtual float predictPoint(float x, float lowerlimit, float upperlimit) const = 0;
+    virtual float predictWith(const float* weights, float x, float lowerlimit, float upperlimit) const = 0;
+    virtual void predictBatchWith(const float* weights, const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const;
+    virtual ActiveWindows getActiveWindows(float x, float lowerlimit, float upperlimit) const = 0;
+    void predictBatch(const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const;
+    template <typename Visit> void forEachActiveWindow(float x, float lowerlimit, float upperlimit, Visit visit) const;
+    template <typename Visit> void forEachActiveCell(float x, float lowerlimit, float upperlimit, Visit visit) const;
+    template <typename Visit> void forEachWeight(Visit visit) const;
+    void setEpochCallback(std::function<bool(int, float)> callback);
+    bool continueTraining(int epoch, float loss);
 };
 
 /**
@@ -67,8 +233,15 @@ class DiscreteCMAC : public CMAC
 public:
     DiscreteCMAC(int gen_factor, int num_weights);
     void updateWeights(std::pair<float, float> data_element, int gen_factor, float lr);
-    void train(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold);
-    std::vector<std::pair<float, float>> predict(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, float& accuracy, bool train);
+    void updateCells(int start_index, std::pair<float, float> data_element, int gen_factor, float lr);
+    void updatePass(const std::vector<std::pair<float, float>>& data, float lr);
+    int learnSample(std::pair<float, float> data_element, float lowerlimit, float upperlimit, float lr);
+    const char* getName() const;
+    std::vector<std::pair<float, float>> predict(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, float& accuracy, bool train);
+    float predictPoint(float x, float lowerlimit, float upperlimit) const;
+    float predictWith(const float* weights, float x, float lowerlimit, float upperlimit) const;
+    void predictBatchWith(const float* weights, const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const;
+    ActiveWindows getActiveWindows(float x, float lowerlimit, float upperlimit) const;
 };
 
 
@@ -78,14 +251,30 @@ public:
  */
 class ContinousCMAC : public CMAC
 {
+private:
+    std::vector<float> input;
+
 public:
     ContinousCMAC(int gen_factor, int num_weights);
     std::vector<float> generateInputVector(int associated_vec_size, float lowerlimit, float upperlimit);
-    void updateWeights(std::pair<float, float> data_element, std::vector<float> input, int gen_factor, float lr);
-    void train(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold);
-    std::vector<std::pair<float, float>> predict(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, float& accuracy, bool train);
+    void updateWeights(std::pair<float, float> data_element, const std::vector<float>& input, int gen_factor, float lr);
+    void updateCells(int start_index, std::pair<float, float> data_element, const std::vector<float>& input, int gen_factor, float lr);
+    void beginTraining(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit);
+    float getActivationGain() const;
+    void updatePass(const std::vector<std::pair<float, float>>& data, float lr);
+    int learnSample(std::pair<float, float> data_element, float lowerlimit, float upperlimit, float lr);
+    const char* getName() const;
+    std::vector<std::pair<float, float>> predict(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, float& accuracy, bool train);
+    float predictPoint(float x, float lowerlimit, float upperlimit) const;
+    float predictWith(const float* weights, float x, float lowerlimit, float upperlimit) const;
+    void predictBatchWith(const float* weights, const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const;
+    ActiveWindows getActiveWindows(float x, float lowerlimit, float upperlimit) const;
 };
 
+std::unique_ptr<CMAC> createCMAC(const std::string& variant, int gen_factor, int num_weights);
+std::unique_ptr<CMAC> createShapeCMAC(const std::string& variant, int gen_factor, int num_weights);
+std::unique_ptr<CMAC> loadCMAC(const std::string& path);
+
 //-----------------------------------------------------------
 
 /**
@@ -94,7 +283,9 @@ public:
  * @param gen_factor Generalization Factor of the algorithm
  * @param num_weights Number of weights allowed
  */
-CMAC::CMAC(int gen_factor, int num_weights) : wt_vector(num_weights, 1)
+CMAC::CMAC(int gen_factor, int num_weights) : wt_vector(num_weights, 1), telemetry_sink(nullptr), metrics(nullptr), update_mode(UPDATE_UNIFORM), rmsprop_decay(0.9),
+    lr_schedule(SCHEDULE_CONSTANT), curr_lr(0), weight_init(INIT_ONES), init_on_begin(false), shuffle_mode(SHUFFLE_NONE), shuffle_seed(0), shuffle_block(64), best_loss(0), best_epoch(0), evals_without_improvement(0),
+    train_lowerlimit(0), train_upperlimit(0), epochs_trained(0), prev_loss(0), curr_loss(0), converged(false), stopped(false), training_elapsed_ns(0)
 {
     this->gen_factor = gen_factor;
     this->num_weights = num_weights;
@@ -114,7 +305,7 @@ void CMAC::setGenFactor(int gf)
  * @brief Getter to get Generalization Factor
  * @return Generalization Factor
  */
-int CMAC::getGenFactor()
+int CMAC::getGenFactor() const
 {
     return gen_factor;
 }
@@ -123,7 +314,7 @@ int CMAC::getGenFactor()
  * @brief Getter to get Associated Vector size
  * @return Associated Vector size
  */
-int CMAC::getAssociatedVecSize()
+int CMAC::getAssociatedVecSize() const
 {
     return associated_vec_size;
 }
@@ -132,7 +323,7 @@ int CMAC::getAssociatedVecSize()
  * @brief Getter to get Weight Vector
  * @return Weight Vector
  */
-std::vector<float> CMAC::getWtVector()
+const WeightVector& CMAC::getWtVector() const
 {
     return wt_vector;
 }
@@ -149,6 +340,376 @@ void CMAC::setWtVector(int start_index, float correction)
         wt_vector[i] += correction;
 }
 
+/**
+ * @brief Free the weight vector of a model that is only used for its shape
+ * E.g. to evaluate predictWith on weights that live elsewhere. The model cannot be trained afterwards.
+ */
+void CMAC::releaseWeights()
+{
+    WeightVector(wt_vector.get_allocator()).swap(wt_vector);
+}
+
+/**
+ * @brief Setter to move the weights to storage with the given page backing
+ * Only weight vectors of at least huge_page_size bytes (524288 weights) get huge pages.
+ *
+ * @param huge_pages Page backing of the weight vector
+ */
+void CMAC::setHugePages(HugePages huge_pages)
+{
+    WeightVector weights(wt_vector.begin(), wt_vector.end(), AlignedAllocator<float>(huge_pages));
+    wt_vector.swap(weights);
+}
+
+/**
+ * @brief Getter to get the page backing of the weight vector
+ * @return Huge page mode
+ */
+HugePages CMAC::getHugePages() const
+{
+    return wt_vector.get_allocator().getHugePages();
+}
+
+/**
+ * @brief Setter to set how sample errors are distributed over the active weights
+ * Takes effect at once (also for learnSample) and resets the per cell state, as beginTraining does.
+ *
+ * @param mode Update mode
+ * @param decay Decay of the squared error average (UPDATE_RMSPROP only)
+ */
+void CMAC::setUpdateMode(UpdateMode mode, float decay = 0.9)
+{
+    update_mode = mode;
+    rmsprop_decay = decay;
+    resetUpdateState();
+}
+
+/**
+ * @brief Getter to get the Update Mode
+ * @return Update mode
+ */
+UpdateMode CMAC::getUpdateMode() const
+{
+    return update_mode;
+}
+
+/**
+ * @brief Size and zero the per cell state that the update mode reads (visit counts or squared error accumulators)
+ */
+void CMAC::resetUpdateState()
+{
+    cell_visits.assign(update_mode == UPDATE_CREDIT ? num_weights : 0, 0);
+    cell_accum.assign(update_mode == UPDATE_ADAGRAD || update_mode == UPDATE_RMSPROP ? num_weights : 0, 0);
+}
+
+/**
+ * @brief Distribute the error of one sample over its gen_factor active weights
+ *
+ * @param start_index Start index associted with first activated weight for corresponding input
+ * @param error Target minus prediction
+ * @param lr Learning Rate for training
+ */
+void CMAC::applyError(int start_index, float error, float lr)
+{
+    int end_index = start_index + gen_factor;
+    switch (update_mode)
+    {
+    case UPDATE_CREDIT:
+    {
+        // Cells visited less often have learned less and get a larger share of the error
+        float credit_sum = 0;
+        for (int i = start_index; i < end_index; i++)
+            credit_sum += 1 / (cell_visits[i] + 1);
+        for (int i = start_index; i < end_index; i++)
+        {
+            wt_vector[i] += lr * error * (1 / (cell_visits[i] + 1)) / credit_sum;
+            cell_visits[i] += 1;
+        }
+        break;
+    }
+    // The accumulator modes split the normalized step over the window like UPDATE_UNIFORM splits the error
+    case UPDATE_ADAGRAD:
+        for (int i = start_index; i < end_index; i++)
+        {
+            cell_accum[i] += error * error;
+            wt_vector[i] += lr * error / (sqrt(cell_accum[i]) + 1e-6f) / gen_factor;
+        }
+        break;
+    case UPDATE_RMSPROP:
+        for (int i = start_index; i < end_index; i++)
+        {
+            cell_accum[i] = rmsprop_decay * cell_accum[i] + (1 - rmsprop_decay) * error * error;
+            wt_vector[i] += lr * error / (sqrt(cell_accum[i]) + 1e-6f) / gen_factor;
+        }
+        break;
+    default:
+        setWtVector(start_index, (lr * error) / gen_factor);
+        break;
+    }
+}
+
+/**
+ * @brief Setter to set the learning rate schedule applied from the next beginTraining
+ * @param schedule Learning rate schedule (LearningRateSchedule::constant() keeps lr fixed)
+ */
+void CMAC::setLearningRateSchedule(const LearningRateSchedule& schedule)
+{
+    lr_schedule = schedule;
+}
+
+/**
+ * @brief Getter to get the learning rate used for the last epoch
+ * @return Learning rate
+ */
+float CMAC::getLearningRate() const
+{
+    return curr_lr;
+}
+
+/**
+ * @brief Change of a sample's own prediction per unit of lr * error when it is learned
+ * Used by SCHEDULE_AUTO to derive the largest stable step. Exact for UPDATE_UNIFORM and UPDATE_CREDIT,
+ * whose shares over the gen_factor active cells sum to one.
+ *
+ * @return Activation gain (1 for a single window of active cells)
+ */
+float CMAC::getActivationGain() const
+{
+    return 1;
+}
+
+/**
+ * @brief Setter to set how beginTraining initializes the weights
+ * Without a call the weights are left as they are (all ones on a new model), so repeated
+ * train calls keep refining the same weights. loadModel turns initialization off again for warm starts.
+ *
+ * @param init Initialization strategy
+ */
+void CMAC::setWeightInit(WeightInit init)
+{
+    weight_init = init;
+    init_on_begin = true;
+}
+
+/**
+ * @brief Initialize the weights from the training data in one pass
+ * Requires the sample cells of beginTraining.
+ *
+ * @param data Continer of the input and output train data passed to beginTraining
+ */
+void CMAC::initializeWeights(const std::vector<std::pair<float, float>>& data)
+{
+    double mean = 0;
+    for (auto& sample : data)
+        mean += sample.second;
+    mean = data.empty() ? 0 : mean / data.size();
+    // A prediction sums gen_factor weights
+    float mean_weight = (float)(mean / gen_factor);
+
+    switch (weight_init)
+    {
+    case INIT_ZEROS:
+        std::fill(wt_vector.begin(), wt_vector.end(), 0.0f);
+        break;
+    case INIT_TARGET_MEAN:
+        std::fill(wt_vector.begin(), wt_vector.end(), mean_weight);
+        break;
+    case INIT_LOCAL_AVERAGE:
+    {
+        // Average target over the receptive field of every cell, cells no sample reaches get the global mean
+        std::vector<double> sums(num_weights, 0);
+        std::vector<int> counts(num_weights, 0);
+        for (size_t i = 0; i < data.size(); i++)
+            for (int j = sample_cells[i]; j < sample_cells[i] + gen_factor; j++)
+            {
+                sums[j] += data[i].second;
+                counts[j]++;
+            }
+        for (int j = 0; j < num_weights; j++)
+            wt_vector[j] = counts[j] ? (float)(sums[j] / counts[j] / gen_factor) : mean_weight;
+        break;
+    }
+    default:
+        std::fill(wt_vector.begin(), wt_vector.end(), 1.0f);
+        break;
+    }
+}
+
+/**
+ * @brief Save the weights and shape of the model to a binary file
+ *
+ * @param path Output file path
+ * @return True if the file was written
+ */
+bool CMAC::saveModel(const std::string& path) const
+{
+    CMAC_TRACE_SCOPE("checkpoint");
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    char name[16] = {};
+    strncpy(name, getName(), sizeof(name) - 1);
+    uint32_t version = 1;
+    file.write("CMAC", 4);
+    file.write((const char*)&version, sizeof(version));
+    file.write(name, sizeof(name));
+    file.write((const char*)&gen_factor, sizeof(gen_factor));
+    file.write((const char*)&num_weights, sizeof(num_weights));
+    file.write((const char*)&train_lowerlimit, sizeof(train_lowerlimit));
+    file.write((const char*)&train_upperlimit, sizeof(train_upperlimit));
+    file.write((const char*)wt_vector.data(), wt_vector.size() * sizeof(float));
+    return (bool)file;
+}
+
+/**
+ * @brief Load weights saved by saveModel into a model of the same variant and shape
+ * Disables weight initialization so the next beginTraining warm-starts from the loaded weights.
+ *
+ * @param path Model file path
+ * @return False if the file is missing, malformed or was saved from a different variant or shape
+ */
+bool CMAC::loadModel(const std::string& path)
+{
+    CMAC_TRACE_SCOPE("checkpoint");
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    uint32_t version;
+    char name[16];
+    int file_gen_factor, file_num_weights;
+    float lowerlimit, upperlimit;
+
+    file.read(magic, 4);
+    file.read((char*)&version, sizeof(version));
+    file.read(name, sizeof(name));
+    file.read((char*)&file_gen_factor, sizeof(file_gen_factor));
+    file.read((char*)&file_num_weights, sizeof(file_num_weights));
+    file.read((char*)&lowerlimit, sizeof(lowerlimit));
+    file.read((char*)&upperlimit, sizeof(upperlimit));
+    if (!file || memcmp(magic, "CMAC", 4) || version != 1 || strncmp(name, getName(), sizeof(name))
+        || file_gen_factor != gen_factor || file_num_weights != num_weights)
+        return false;
+
+    std::vector<float> weights(num_weights);
+    file.read((char*)weights.data(), weights.size() * sizeof(float));
+    if (!file)
+        return false;
+
+    wt_vector.assign(weights.begin(), weights.end());
+    train_lowerlimit = lowerlimit;
+    train_upperlimit = upperlimit;
+    init_on_begin = false;
+    return true;
+}
+
+/**
+ * @brief Setter to set the order in which training epochs visit the samples
+ * Orders are regenerated from (seed, epoch) every epoch, so resumed runs see the same sequence.
+ *
+ * @param mode Shuffle mode
+ * @param seed Seed of the permutations
+ * @param block_size Samples per block (SHUFFLE_BLOCK only)
+ */
+void CMAC::setShuffle(ShuffleMode mode, uint64_t seed = 0, size_t block_size = 64)
+{
+    shuffle_mode = mode;
+    shuffle_seed = seed;
+    shuffle_block = std::max<size_t>(1, block_size);
+}
+
+/**
+ * @brief Getter to get the sample order of the current epoch
+ * @return Indices into the training data
+ */
+const std::vector<uint32_t>& CMAC::getTrainingOrder() const
+{
+    return training_order;
+}
+
+/**
+ * @brief Start index of the active weights of a training sample, cached by beginTraining
+ * Saves the association map lookup in the update pass.
+ *
+ * @param sample Index into the training data
+ * @return Start index into the weight vector
+ */
+int CMAC::getSampleCell(uint32_t sample) const
+{
+    return sample_cells[sample];
+}
+
+/**
+ * @brief Setter to enable early stopping on a validation set
+ * With a validation set the loss is only evaluated every settings.eval_every epochs, on the validation
+ * data, and training stops once it has not improved for settings.patience evaluations instead of on the
+ * convergence threshold. The data is not copied and must outlive training.
+ *
+ * @param validation_data Continer of the input and output validation data (empty disables early stopping)
+ * @param settings Early stopping settings
+ */
+void CMAC::setValidation(Span<std::pair<float, float>> validation_data, const EarlyStopping& settings = EarlyStopping())
+{
+    validation = validation_data;
+    early_stopping = settings;
+    early_stopping.eval_every = std::max(1, early_stopping.eval_every);
+    early_stopping.patience = std::max(1, early_stopping.patience);
+}
+
+/**
+ * @brief Getter to get the lowest validation loss seen since training began
+ * @return Best validation loss
+ */
+float CMAC::getBestLoss() const
+{
+    return best_loss;
+}
+
+/**
+ * @brief Getter to get the epoch of the lowest validation loss
+ * @return Epoch number (0 before the first evaluation)
+ */
+int CMAC::getBestEpoch() const
+{
+    return best_epoch;
+}
+
+/**
+ * @brief Put back the weights of the best validation evaluation (no-op without one)
+ */
+void CMAC::restoreBestWeights()
+{
+    if (!best_weights.empty())
+        wt_vector = best_weights;
+}
+
+/**
+ * @brief RMSE of the current weights on the (subsampled) validation set
+ * Uses predictPoint, so the association map of the training data is left untouched.
+ *
+ * @return Validation loss
+ */
+float CMAC::validationLoss()
+{
+    size_t n = validation.size();
+    size_t stride = 1;
+    if (early_stopping.max_samples > 0 && n > (size_t)early_stopping.max_samples)
+        stride = (n + early_stopping.max_samples - 1) / early_stopping.max_samples;
+
+    // Validation queries are not served traffic, so they bypass predictPoint and its query metrics
+    validation_predictions.clear();
+    for (size_t i = 0; i < n; i += stride)
+        validation_predictions.push_back({ validation[i].first, predictWith(wt_vector.data(), validation[i].first, train_lowerlimit, train_upperlimit) });
+
+    if (stride == 1)
+        return calculateError(validation, validation_predictions);
+
+    std::vector<std::pair<float, float>> targets;
+    targets.reserve(validation_predictions.size());
+    for (size_t i = 0; i < n; i += stride)
+        targets.push_back(validation[i]);
+    return calculateError(targets, validation_predictions);
+}
+
 /**
  * @brief Getter to get Association Value given a key
  *
@@ -171,20 +732,126 @@ void CMAC::setAssociationMapValue(float key, int value)
     association_map[key] = value;
 }
 
+/**
+ * @brief Setter to set the Telemetry Sink receiving per epoch training records
+ * @param sink Telemetry sink (nullptr disables epoch logging)
+ */
+void CMAC::setTelemetrySink(TelemetrySink* sink)
+{
+    telemetry_sink = sink;
+}
+
+/**
+ * @brief Getter to get the Telemetry Sink
+ * @return Telemetry sink (nullptr if epoch logging is disabled)
+ */
+TelemetrySink* CMAC::getTelemetrySink()
+{
+    return telemetry_sink;
+}
+
+/**
+ * @brief Setter to set the metrics updated by training and inference
+ * @param model_metrics Metrics of this model (nullptr disables metrics)
+ */
+void CMAC::setMetrics(CMACMetrics* model_metrics)
+{
+    metrics = model_metrics;
+}
+
+/**
+ * @brief Getter to get the metrics of this model
+ * @return Metrics (nullptr if disabled)
+ */
+CMACMetrics* CMAC::getMetrics() const
+{
+    return metrics;
+}
+
+/**
+ * @brief Getter to get the number of epochs run since training began
+ * @return Number of epochs
+ */
+int CMAC::getEpochsTrained() const
+{
+    return epochs_trained;
+}
+
+/**
+ * @brief Getter to get the loss of the last evaluation
+ * @return Training loss, or validation loss when early stopping is enabled
+ */
+float CMAC::getLoss() const
+{
+    return curr_loss;
+}
+
+/**
+ * @brief Getter to tell whether training met the convergence threshold
+ * @return True if converged
+ */
+bool CMAC::isConverged() const
+{
+    return converged;
+}
+
+/**
+ * @brief Getter to tell whether resuming training would do any more work
+ * @return True if training converged or was stopped by the epoch callback
+ */
+bool CMAC::isTrainingFinished() const
+{
+    return converged || stopped;
+}
+
+/**
+ * @brief Setter to set a callback invoked after every training epoch
+ * Lets a caller such as the hyperparameter sweep stop unpromising runs early.
+ *
+ * @param callback Called with (epoch, loss); returning false stops training
+ */
+void CMAC::setEpochCallback(std::function<bool(int, float)> callback)
+{
+    epoch_callback = callback;
+}
+
+/**
+ * @brief Ask the epoch callback whether training should go on
+ *
+ * @param epoch Number of epochs completed
+ * @param loss Current training loss
+ * @return False if the callback asked to stop
+ */
+bool CMAC::continueTraining(int epoch, float loss)
+{
+    return !epoch_callback || epoch_callback(epoch, loss);
+}
+
+/**
+ * @brief Hash a single input value to the start index of its active weights
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Start index into the weight vector
+ */
+int CMAC::getAssociationIndex(float x, float lowerlimit, float upperlimit) const
+{
+    // Hash function to generate index (proportionate ==> can use other functions too)
+    float associated_vec_index = (associated_vec_size - 2) * ((x - lowerlimit) / (upperlimit - lowerlimit)) + 1;
+    return (int)associated_vec_index;
+}
+
 /**
  * @brief Function to calculte error between actual and predicted data 
  *
  * @param data Continer of the input and output data values
  * @param predicted_data Continer of the input and output predicted data values
- * @return Error Value
+ * @return Root mean squared error (see computeErrorMetrics for the other metrics)
  */
-float CMAC::calculateError(std::vector<std::pair<float, float>> data, std::vector<std::pair<float, float>> predicted_data)
+float CMAC::calculateError(Span<std::pair<float, float>> data, Span<std::pair<float, float>> predicted_data) const
 {
-    int sum = 0; int n = data.size();
-    for (int i = 0; i < n; i++)
-        sum += pow(data[i].second - predicted_data[i].second, 2);
-
-    return sqrt(sum) / n;
+    return (float)computeErrorMetrics(data, predicted_data).rmse;
 }
 
 /**
@@ -194,17 +861,282 @@ float CMAC::calculateError(std::vector<std::pair<float, float>> data, std::vecto
  * @param lowerlimit Lowerlimit value for the data samples
  * @param upperlimit Uperlimit value for the data samples
  */
-void CMAC::generateAssociationMap(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit)
+void CMAC::generateAssociationMap(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit)
 {
+    CMAC_TRACE_SCOPE("generateAssociationMap");
+    CMAC_PERF_SCOPE(PERF_ASSOCIATION);
     association_map.clear();
-    int associated_vec_size = getAssociatedVecSize();
-    float associated_vec_index;
     for (int i = 0; i < data.size(); i++)
+        association_map[data[i].first] = getAssociationIndex(data[i].first, lowerlimit, upperlimit);
+}
+
+/**
+ * @brief Start a new (resumable) training run on a dataset
+ *
+ * @param data Continer of the input and output train data for training
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+void CMAC::beginTraining(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit)
+{
+    CMAC_TRACE_SCOPE("beginTraining");
+    generateAssociationMap(data, lowerlimit, upperlimit);
+    train_lowerlimit = lowerlimit;
+    train_upperlimit = upperlimit;
+    epochs_trained = 0;
+    prev_loss = 0;
+    curr_loss = 0;
+    converged = false;
+    stopped = false;
+    training_elapsed_ns = 0;
+    lr_schedule.reset(getActivationGain());
+    training_order.resize(data.size());
+    sample_cells.resize(data.size());
+    for (size_t i = 0; i < data.size(); i++)
     {
-        // Hash function to generate index (proportionate ==> can use other functions too)
-        associated_vec_index = (associated_vec_size - 2) * ((data[i].first - lowerlimit) / (upperlimit - lowerlimit)) + 1;
-        association_map[data[i].first] = (int)associated_vec_index;
+        training_order[i] = (uint32_t)i;
+        sample_cells[i] = association_map[data[i].first];
     }
+    if (init_on_begin)
+        initializeWeights(data);
+    sorted_order.clear();
+    bucket_starts.clear();
+    if (shuffle_mode == SHUFFLE_BLOCK || shuffle_mode == SHUFFLE_SORTED)
+    {
+        sorted_order = training_order;
+        std::stable_sort(sorted_order.begin(), sorted_order.end(), [&](uint32_t a, uint32_t b) {
+            return sample_cells[a] < sample_cells[b];
+        });
+        if (shuffle_mode == SHUFFLE_SORTED)
+            training_order = sorted_order;
+    }
+    else if (shuffle_mode == SHUFFLE_BUCKET)
+    {
+        // 64 byte cache lines of the weight vector
+        const uint32_t weights_per_line = 64 / sizeof(float);
+        std::vector<uint32_t> keys(data.size());
+        for (size_t i = 0; i < data.size(); i++)
+            keys[i] = (uint32_t)sample_cells[i] / weights_per_line;
+        bucketSort(keys, sorted_order, bucket_starts);
+    }
+    best_weights.clear();
+    best_loss = 0;
+    best_epoch = 0;
+    evals_without_improvement = 0;
+    resetUpdateState();
+}
+
+/**
+ * @brief Run up to the given number of further epochs of the run started by beginTraining
+ * Training can be paused after any call and resumed later with the same data.
+ *
+ * @param data Continer of the input and output train data passed to beginTraining
+ * @param epochs Maximum number of epochs to run in this call
+ * @param lr Learning Rate for training (base rate of the learning rate schedule)
+ * @param convergenceThreshold Predefined threshold for convergence criteria of CMAC
+ * @return True if training has converged or was stopped, i.e. there is nothing left to resume
+ */
+bool CMAC::trainEpochs(const std::vector<std::pair<float, float>>& data, int epochs, float lr, float convergenceThreshold)
+{
+    int last_epoch = epochs_trained + epochs;
+    float accuracy = 1 - curr_loss;
+    auto start_time = std::chrono::steady_clock::now();
+
+    while (epochs_trained < last_epoch && !converged && !stopped)
+    {
+        CMAC_TRACE_SCOPE("epoch");
+        prev_loss = curr_loss;
+
+        {
+            CMAC_TRACE_SCOPE("updateWeights batch");
+            CMAC_PERF_SCOPE(PERF_UPDATE);
+            auto update_start = metrics ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            curr_lr = lr_schedule.rate(epochs_trained, lr, curr_loss);
+            if (shuffle_mode == SHUFFLE_EPOCH)
+            {
+                for (size_t i = 0; i < training_order.size(); i++)
+                    training_order[i] = (uint32_t)i;
+                permute(training_order, 0, training_order.size(), shuffle_seed, epochs_trained);
+            }
+            else if (shuffle_mode == SHUFFLE_BLOCK)
+                blockShuffle(sorted_order, training_order, shuffle_block, shuffle_seed, epochs_trained);
+            else if (shuffle_mode == SHUFFLE_BUCKET)
+                bucketShuffle(sorted_order, bucket_starts, training_order, shuffle_seed, epochs_trained);
+            updatePass(data, curr_lr);
+            if (metrics && !data.empty())
+            {
+                metrics->samples_learned.add(data.size());
+                metrics->update_latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - update_start).count() / data.size());
+            }
+        }
+
+        if (validation.empty())
+        {
+            {
+                CMAC_TRACE_SCOPE("evaluate");
+                CMAC_PERF_SCOPE(PERF_EVALUATE);
+                predict(data, train_lowerlimit, train_upperlimit, accuracy, true);
+            }
+
+            curr_loss = 1 - accuracy;
+
+            if (abs(prev_loss - curr_loss) < convergenceThreshold)
+                converged = true;
+        }
+        else if ((epochs_trained + 1) % early_stopping.eval_every == 0)
+        {
+            {
+                CMAC_TRACE_SCOPE("validate");
+                CMAC_PERF_SCOPE(PERF_EVALUATE);
+                curr_loss = validationLoss();
+            }
+            accuracy = 1 - curr_loss;
+
+            if (best_weights.empty() || curr_loss < best_loss - early_stopping.min_delta)
+            {
+                best_loss = curr_loss;
+                best_epoch = epochs_trained + 1;
+                best_weights = wt_vector;
+                evals_without_improvement = 0;
+            }
+            else if (++evals_without_improvement >= early_stopping.patience)
+            {
+                converged = true;
+                if (early_stopping.restore_best)
+                    restoreBestWeights();
+            }
+        }
+
+        epochs_trained++;
+        if (metrics)
+        {
+            double norm = 0;
+            for (float w : wt_vector)
+                norm += (double)w * w;
+            metrics->rmse.set(curr_loss);
+            metrics->weight_norm.set(sqrt(norm));
+        }
+        EpochRecord record = {};
+        record.tag = getName();
+        record.epoch = epochs_trained;
+        record.loss = curr_loss;
+        record.accuracy = accuracy;
+        record.elapsed_ns = training_elapsed_ns + std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+#if CMAC_PERF_ENABLED
+        PerfCounters::local().collect(record.phases);
+#endif
+        if (telemetry_sink)
+            telemetry_sink->push(record);
+
+        if (!continueTraining(epochs_trained, curr_loss))
+        {
+            stopped = true;
+            if (!validation.empty() && early_stopping.restore_best)
+                restoreBestWeights();
+        }
+    }
+    training_elapsed_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+    return converged || stopped;
+}
+
+/**
+ * @brief Train function for the CMAC class
+ *
+ * @param data Continer of the input and output train data for training
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param epochs Number of times we want to iterate on the full dataset
+ * @param lr Learning Rate for training
+ * @param convergenceThreshold Predefined threshold for convergence criteria of CMAC
+ */
+void CMAC::train(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold)
+{
+    beginTraining(data, lowerlimit, upperlimit);
+    // Epochs 0..epochs inclusive, as before training became resumable
+    trainEpochs(data, epochs + 1, lr, convergenceThreshold);
+    // Training also stops when the epoch budget runs out before the patience does
+    if (!validation.empty() && early_stopping.restore_best)
+        restoreBestWeights();
+}
+
+/**
+ * @brief Predict a batch of input values from an external weight array of this model's shape
+ * The base version calls predictWith per input, variants override it with a loop that keeps
+ * the shape constants out of the per input work.
+ *
+ * @param weights Weight array with num_weights entries
+ * @param x Input values
+ * @param out Receives n predicted output values
+ * @param n Number of inputs
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+void CMAC::predictBatchWith(const float* weights, const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = predictWith(weights, x[i], lowerlimit, upperlimit);
+}
+
+/**
+ * @brief Predict a batch of input values without touching the association map
+ * Safe to call concurrently from several threads on a trained model.
+ *
+ * @param x Input values
+ * @param out Receives n predicted output values
+ * @param n Number of inputs
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+void CMAC::predictBatch(const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const
+{
+    predictBatchWith(wt_vector.data(), x, out, n, lowerlimit, upperlimit);
+    if (metrics)
+        metrics->queries_served.add(n);
+}
+
+/**
+ * @brief Walk the windows a prediction for x reads, for weight storage outside the model
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param visit Called as visit(start, share) for every window of gen_factor cells
+ */
+template <typename Visit>
+void CMAC::forEachActiveWindow(float x, float lowerlimit, float upperlimit, Visit visit) const
+{
+    ActiveWindows windows = getActiveWindows(x, lowerlimit, upperlimit);
+    for (int w = 0; w < windows.count; w++)
+        visit(windows.start[w], windows.share[w]);
+}
+
+/**
+ * @brief Walk the cells a prediction for x reads, for weight storage outside the model
+ * A cell in both continous windows is visited twice, once with each share, as predictWith reads it.
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param visit Called as visit(cell, share) for every active cell
+ */
+template <typename Visit>
+void CMAC::forEachActiveCell(float x, float lowerlimit, float upperlimit, Visit visit) const
+{
+    forEachActiveWindow(x, lowerlimit, upperlimit, [&](int start, float share) {
+        for (int c = start; c < start + gen_factor; c++)
+            visit(c, share);
+    });
+}
+
+/**
+ * @brief Walk the weights of the model, e.g. to import them into other storage
+ * @param visit Called as visit(index, weight) for every weight
+ */
+template <typename Visit>
+void CMAC::forEachWeight(Visit visit) const
+{
+    for (size_t i = 0; i < wt_vector.size(); i++)
+        visit(i, wt_vector[i]);
 }
 
 //----------------------------------------------------
@@ -227,56 +1159,72 @@ DiscreteCMAC::DiscreteCMAC(int gen_factor, int num_weights) : CMAC(gen_factor, n
 
 void DiscreteCMAC::updateWeights(std::pair<float, float> data_element, int gen_factor, float lr)
 {
-    int start_index = getAssociationMapValue(data_element.first);
-    int y_pred = 0;
-    std::vector<float> weights = getWtVector();
+    updateCells(getAssociationMapValue(data_element.first), data_element, gen_factor, lr);
+}
+
+/**
+ * @brief Weight update for a sample whose start index is already known
+ *
+ * @param start_index Start index associted with first activated weight for corresponding input
+ * @param data_element Pair of the input and output data value 
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param lr Learning Rate for training
+ */
+void DiscreteCMAC::updateCells(int start_index, std::pair<float, float> data_element, int gen_factor, float lr)
+{
+    float y_pred = 0;
+    const WeightVector& weights = getWtVector();
 
     for (int i = start_index; i < start_index + gen_factor; i++)
         y_pred += weights[i];
 
     float error = data_element.second - y_pred;
-    float correction = (lr * error) / gen_factor;
-    setWtVector(start_index, correction);
+    applyError(start_index, error, lr);
 }
 
 /**
- * @brief Train function for the Discrete CMAC class
+ * @brief One pass of weight updates over the training data in the order of getTrainingOrder()
  *
- * @param data Continer of the input and output train data for training 
- * @param lowerlimit Lowerlimit value for the data samples
- * @param upperlimit Uperlimit value for the data samples
- * @param epochs Number of times we want to iterate on the full dataset
+ * @param data Continer of the input and output train data passed to beginTraining
  * @param lr Learning Rate for training
- * @param convergenceThreshold Predefined threshold for convergence criteria of CMAC
  */
-
-void DiscreteCMAC::train(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold)
+void DiscreteCMAC::updatePass(const std::vector<std::pair<float, float>>& data, float lr)
 {
-    generateAssociationMap(data, lowerlimit, upperlimit);
-
-    int epoch = 0;
-    float prev_loss = 0, curr_loss = 0;
-    bool isConverged = false;
     int gf = getGenFactor();
-    float accuracy = 0.0;
+    for (uint32_t i : getTrainingOrder())
+        updateCells(getSampleCell(i), data[i], gf, lr);
+}
 
-    while (epoch <= epochs && !isConverged)
+/**
+ * @brief Online update for one sample, without an association map or a training run
+ *
+ * @param data_element Pair of the input and output data value 
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param lr Learning Rate for training
+ * @return Start index of the updated weights (gen_factor weights from there)
+ */
+int DiscreteCMAC::learnSample(std::pair<float, float> data_element, float lowerlimit, float upperlimit, float lr)
+{
+    CMACMetrics* model_metrics = getMetrics();
+    auto update_start = model_metrics ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int start_index = getAssociationIndex(data_element.first, lowerlimit, upperlimit);
+    updateCells(start_index, data_element, getGenFactor(), lr);
+    if (model_metrics)
     {
-        prev_loss = curr_loss;
-
-        for (int i = 0; i < data.size(); i++)
-            updateWeights(data[i], gf, lr);
-
-        predict(data, lowerlimit, upperlimit, accuracy, true);
-
-        curr_loss = 1 - accuracy;
-
-        if (abs(prev_loss - curr_loss) < convergenceThreshold)
-            isConverged = true;
-        
-        epoch++;
-        std::cout << "DicreteCMAC Training in Progress: " << " Epoch: " << epoch << " Accuracy: " << accuracy*100 << " Error: " << curr_loss << std::endl;
+        model_metrics->samples_learned.add(1);
+        model_metrics->update_latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - update_start).count());
     }
+    return start_index;
+}
+
+/**
+ * @brief Getter to get the model name used in training logs
+ * @return Model name
+ */
+const char* DiscreteCMAC::getName() const
+{
+    return "DiscreteCMAC";
 }
 
 /**
@@ -290,9 +1238,12 @@ void DiscreteCMAC::train(std::vector<std::pair<float, float>> data, float lowerl
  * @return Contianer of predicted data (having both input and output values) 
  */
 
-std::vector<std::pair<float, float>> DiscreteCMAC::predict(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, float& accuracy, bool train = false)
+std::vector<std::pair<float, float>> DiscreteCMAC::predict(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, float& accuracy, bool train = false)
 {
+    CMAC_TRACE_SCOPE("predict");
     std::vector<std::pair<float, float>> predicted_data;
+    predicted_data.reserve(data.size());
+    const WeightVector& weights = getWtVector();
     if (!train)
         generateAssociationMap(data, lowerlimit, upperlimit);
 
@@ -301,16 +1252,97 @@ std::vector<std::pair<float, float>> DiscreteCMAC::predict(std::vector<std::pair
     {
         int start_index = getAssociationMapValue(data[i].first);
         float res = 0;
-        std::vector<float> weights = getWtVector();
         for (int j = start_index; j < start_index + gf; j++)
             res += weights[j];
 
         predicted_data.push_back({ data[i].first, res });
     }
     accuracy = 1 - abs(calculateError(data, predicted_data));
+    CMACMetrics* model_metrics = getMetrics();
+    if (model_metrics && !train)
+        model_metrics->queries_served.add(data.size());
     return predicted_data;
 }
 
+/**
+ * @brief Predict a single input value without touching the association map
+ * Safe to call concurrently from several threads on a trained model.
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Predicted output value
+ */
+float DiscreteCMAC::predictPoint(float x, float lowerlimit, float upperlimit) const
+{
+    float res = predictWith(getWtVector().data(), x, lowerlimit, upperlimit);
+    CMACMetrics* model_metrics = getMetrics();
+    if (model_metrics)
+        model_metrics->queries_served.add();
+    return res;
+}
+
+/**
+ * @brief Predict a single input value from an external weight array of this model's shape
+ * Used to serve published snapshots while the model itself keeps training.
+ *
+ * @param weights Weight array with num_weights entries
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Predicted output value
+ */
+float DiscreteCMAC::predictWith(const float* weights, float x, float lowerlimit, float upperlimit) const
+{
+    int start_index = getAssociationIndex(x, lowerlimit, upperlimit);
+    int gf = getGenFactor();
+
+    float res = 0;
+    for (int j = start_index; j < start_index + gf; j++)
+        res += weights[j];
+    return res;
+}
+
+/**
+ * @brief Predict a batch of input values from an external weight array of this model's shape
+ *
+ * @param weights Weight array with num_weights entries
+ * @param x Input values
+ * @param out Receives n predicted output values
+ * @param n Number of inputs
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+void DiscreteCMAC::predictBatchWith(const float* weights, const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const
+{
+    int gf = getGenFactor();
+    for (size_t i = 0; i < n; i++)
+    {
+        int start_index = getAssociationIndex(x[i], lowerlimit, upperlimit);
+        float res = 0;
+        for (int j = start_index; j < start_index + gf; j++)
+            res += weights[j];
+        out[i] = res;
+    }
+}
+
+/**
+ * @brief Cells that predictWith reads for an input value
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return One window of gen_factor cells with share 1
+ */
+ActiveWindows DiscreteCMAC::getActiveWindows(float x, float lowerlimit, float upperlimit) const
+{
+    ActiveWindows windows = {};
+    windows.start[0] = getAssociationIndex(x, lowerlimit, upperlimit);
+    windows.share[0] = 1;
+    windows.count = 1;
+    return windows;
+}
+
 
 //-------------------------------------------
 
@@ -348,10 +1380,22 @@ std::vector<float> ContinousCMAC::generateInputVector(int associated_vec_size, f
  * @param gen_factor Generalization Factor of the algorithm
  * @param lr Learning Rate for training
  */
-void ContinousCMAC::updateWeights(std::pair<float, float> data_element, std::vector<float> input, int gen_factor, float lr)
+void ContinousCMAC::updateWeights(std::pair<float, float> data_element, const std::vector<float>& input, int gen_factor, float lr)
 {
+    updateCells(getAssociationMapValue(data_element.first), data_element, input, gen_factor, lr);
+}
 
-    int start_index = getAssociationMapValue(data_element.first);
+/**
+ * @brief Weight update for a sample whose start index is already known
+ *
+ * @param start_index Start index associted with first activated weight for corresponding input
+ * @param data_element Pair of the input and output data value 
+ * @param input Continer contining the equally spaced elements
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param lr Learning Rate for training
+ */
+void ContinousCMAC::updateCells(int start_index, std::pair<float, float> data_element, const std::vector<float>& input, int gen_factor, float lr)
+{
     int next_index;
 
     if (start_index < getAssociatedVecSize() - (gen_factor + 1))
@@ -359,7 +1403,7 @@ void ContinousCMAC::updateWeights(std::pair<float, float> data_element, std::vec
     else
         next_index = start_index;
 
-    std::vector<float> weights = getWtVector();
+    const WeightVector& weights = getWtVector();
 
     float left_dist, left_wt;
     float right_dist, right_wt;
@@ -369,7 +1413,7 @@ void ContinousCMAC::updateWeights(std::pair<float, float> data_element, std::vec
     left_wt = right_dist / (left_dist + right_dist);
     right_wt = 1 - left_wt;
 
-    int y_pred = 0;
+    float y_pred = 0;
     for (int i = start_index; i < start_index + gen_factor; i++)
         y_pred += weights[i] * left_wt;
 
@@ -378,53 +1422,80 @@ void ContinousCMAC::updateWeights(std::pair<float, float> data_element, std::vec
 
 
     float error = data_element.second - y_pred;
-    float correction = (lr * error) / gen_factor;
-    setWtVector(start_index, correction);
-    setWtVector(next_index, correction);
+    applyError(start_index, error, lr);
+    applyError(next_index, error, lr);
 }
 
 /**
- * @brief Train function for the Continous CMAC class
+ * @brief Start a new (resumable) training run and cache the equally spaced inputs
  *
  * @param data Continer of the input and output train data for training 
  * @param lowerlimit Lowerlimit value for the data samples
  * @param upperlimit Uperlimit value for the data samples
- * @param epochs Number of times we want to iterate on the full dataset
- * @param lr Learning Rate for training
- * @param convergenceThreshold Predefined threshold for convergence criteria of CMAC
  */
-
-void ContinousCMAC::train(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, int epochs, float lr, float convergenceThreshold)
+void ContinousCMAC::beginTraining(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit)
 {
-    generateAssociationMap(data, lowerlimit, upperlimit);
-
-    int associated_vec_size = getAssociatedVecSize();
-    std::vector<float> input = generateInputVector(associated_vec_size, lowerlimit, upperlimit);
+    CMAC::beginTraining(data, lowerlimit, upperlimit);
+    input = generateInputVector(getAssociatedVecSize(), lowerlimit, upperlimit);
+}
 
+/**
+ * @brief Change of a sample's own prediction per unit of lr * error when it is learned
+ * Both neighbouring windows receive the full correction, so the gain is (2 * gen_factor - 1) / gen_factor
+ * and 2 when the windows coincide at the upper edge.
+ *
+ * @return Activation gain
+ */
+float ContinousCMAC::getActivationGain() const
+{
+    return 2;
+}
 
-    int epoch = 0;
-    float prev_loss = 0, curr_loss = 0;
-    bool isConverged = false;
+/**
+ * @brief One pass of weight updates over the training data in the order of getTrainingOrder()
+ *
+ * @param data Continer of the input and output train data passed to beginTraining
+ * @param lr Learning Rate for training
+ */
+void ContinousCMAC::updatePass(const std::vector<std::pair<float, float>>& data, float lr)
+{
     int gf = getGenFactor();
-    float accuracy = 0.0;
+    for (uint32_t i : getTrainingOrder())
+        updateCells(getSampleCell(i), data[i], input, gf, lr);
+}
 
-    while (epoch <= epochs && !isConverged)
+/**
+ * @brief Online update for one sample, without an association map or a training run
+ *
+ * @param data_element Pair of the input and output data value 
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param lr Learning Rate for training
+ * @return Start index of the updated weights (gen_factor + 1 weights from there)
+ */
+int ContinousCMAC::learnSample(std::pair<float, float> data_element, float lowerlimit, float upperlimit, float lr)
+{
+    CMACMetrics* model_metrics = getMetrics();
+    auto update_start = model_metrics ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    if (input.size() != (size_t)getAssociatedVecSize())
+        input = generateInputVector(getAssociatedVecSize(), lowerlimit, upperlimit);
+    int start_index = getAssociationIndex(data_element.first, lowerlimit, upperlimit);
+    updateCells(start_index, data_element, input, getGenFactor(), lr);
+    if (model_metrics)
     {
-        prev_loss = curr_loss;
-
-        for (int i = 0; i < data.size(); i++)
-            updateWeights(data[i], input, gf, lr);
-
-        predict(data, lowerlimit, upperlimit, accuracy, true);
-
-        curr_loss = 1 - accuracy;
-
-        if (abs(prev_loss - curr_loss) < convergenceThreshold)
-            isConverged = true;
-
-        epoch++;
-        std::cout << "ContinousCMAC Training in Progress: " << " Epoch: " << epoch << " Accuracy: " << accuracy*100 << " Error: " << curr_loss << std::endl;
+        model_metrics->samples_learned.add(1);
+        model_metrics->update_latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - update_start).count());
     }
+    return start_index;
+}
+
+/**
+ * @brief Getter to get the model name used in training logs
+ * @return Model name
+ */
+const char* ContinousCMAC::getName() const
+{
+    return "ContinousCMAC";
 }
 
 /**
@@ -438,9 +1509,12 @@ void ContinousCMAC::train(std::vector<std::pair<float, float>> data, float lower
  * @return Contianer of predicted data (having both input and output values) 
  */
 
-std::vector<std::pair<float, float>> ContinousCMAC::predict(std::vector<std::pair<float, float>> data, float lowerlimit, float upperlimit, float& accuracy, bool train = false)
+std::vector<std::pair<float, float>> ContinousCMAC::predict(const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit, float& accuracy, bool train = false)
 {
+    CMAC_TRACE_SCOPE("predict");
     std::vector<std::pair<float, float>> predicted_data;
+    predicted_data.reserve(data.size());
+    const WeightVector& weights = getWtVector();
     int associated_vec_size = getAssociatedVecSize();
     std::vector<float> input = generateInputVector(associated_vec_size, lowerlimit, upperlimit);
 
@@ -467,7 +1541,6 @@ std::vector<std::pair<float, float>> ContinousCMAC::predict(std::vector<std::pai
         right_wt = 1 - left_wt;
 
         float res = 0;
-        std::vector<float> weights = getWtVector();
         for (int i = start_index; i < start_index + gf; i++)
             res += weights[i] * left_wt;
 
@@ -478,5 +1551,192 @@ std::vector<std::pair<float, float>> ContinousCMAC::predict(std::vector<std::pai
 
     }
     accuracy = 1 - abs(calculateError(data, predicted_data));
+    CMACMetrics* model_metrics = getMetrics();
+    if (model_metrics && !train)
+        model_metrics->queries_served.add(data.size());
     return predicted_data;
 }
+
+/**
+ * @brief Predict a single input value without touching the association map
+ * Safe to call concurrently from several threads on a trained model.
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Predicted output value
+ */
+float ContinousCMAC::predictPoint(float x, float lowerlimit, float upperlimit) const
+{
+    float res = predictWith(getWtVector().data(), x, lowerlimit, upperlimit);
+    CMACMetrics* model_metrics = getMetrics();
+    if (model_metrics)
+        model_metrics->queries_served.add();
+    return res;
+}
+
+/**
+ * @brief Predict a single input value from an external weight array of this model's shape
+ * Used to serve published snapshots while the model itself keeps training.
+ *
+ * @param weights Weight array with num_weights entries
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Predicted output value
+ */
+float ContinousCMAC::predictWith(const float* weights, float x, float lowerlimit, float upperlimit) const
+{
+    int associated_vec_size = getAssociatedVecSize();
+    int gf = getGenFactor();
+    int start_index = getAssociationIndex(x, lowerlimit, upperlimit);
+    int next_index;
+
+    if (start_index < associated_vec_size - (gf + 1))
+        next_index = start_index + 1;
+    else
+        next_index = start_index;
+
+    // Same equally spaced inputs as generateInputVector, computed on the fly
+    float increment = 2 * PI / (associated_vec_size - 1);
+    float left_dist = abs(start_index * increment - x);
+    float right_dist = abs(next_index * increment - x);
+    float left_wt = right_dist / (left_dist + right_dist);
+    float right_wt = 1 - left_wt;
+
+    float res = 0;
+    for (int i = start_index; i < start_index + gf; i++)
+        res += weights[i] * left_wt;
+
+    for (int i = next_index; i < next_index + gf; i++)
+        res += weights[i] * right_wt;
+    return res;
+}
+
+/**
+ * @brief Predict a batch of input values from an external weight array of this model's shape
+ *
+ * @param weights Weight array with num_weights entries
+ * @param x Input values
+ * @param out Receives n predicted output values
+ * @param n Number of inputs
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+void ContinousCMAC::predictBatchWith(const float* weights, const float* x, float* out, size_t n, float lowerlimit, float upperlimit) const
+{
+    int associated_vec_size = getAssociatedVecSize();
+    int gf = getGenFactor();
+    float increment = 2 * PI / (associated_vec_size - 1);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int start_index = getAssociationIndex(x[i], lowerlimit, upperlimit);
+        int next_index = start_index < associated_vec_size - (gf + 1) ? start_index + 1 : start_index;
+        float left_dist = abs(start_index * increment - x[i]);
+        float right_dist = abs(next_index * increment - x[i]);
+        float left_wt = right_dist / (left_dist + right_dist);
+        float right_wt = 1 - left_wt;
+
+        float res = 0;
+        for (int j = start_index; j < start_index + gf; j++)
+            res += weights[j] * left_wt;
+        for (int j = next_index; j < next_index + gf; j++)
+            res += weights[j] * right_wt;
+        out[i] = res;
+    }
+}
+
+/**
+ * @brief Cells that predictWith reads for an input value
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return The windows left and right of the input with their interpolation weights
+ */
+ActiveWindows ContinousCMAC::getActiveWindows(float x, float lowerlimit, float upperlimit) const
+{
+    int associated_vec_size = getAssociatedVecSize();
+    int start_index = getAssociationIndex(x, lowerlimit, upperlimit);
+    int next_index = start_index < associated_vec_size - (getGenFactor() + 1) ? start_index + 1 : start_index;
+    float increment = 2 * PI / (associated_vec_size - 1);
+    float left_dist = abs(start_index * increment - x);
+    float right_dist = abs(next_index * increment - x);
+
+    ActiveWindows windows;
+    windows.start[0] = start_index;
+    windows.start[1] = next_index;
+    windows.share[0] = right_dist / (left_dist + right_dist);
+    windows.share[1] = 1 - windows.share[0];
+    windows.count = 2;
+    return windows;
+}
+
+//-------------------------------------------
+
+/**
+ * @brief Construct a fresh CMAC of the requested variant
+ *
+ * @param variant "discrete" or "continous"
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param num_weights Number of weights allowed
+ * @return Owning pointer to the model
+ */
+std::unique_ptr<CMAC> createCMAC(const std::string& variant, int gen_factor, int num_weights)
+{
+    if (variant == "discrete")
+        return std::unique_ptr<CMAC>(new DiscreteCMAC(gen_factor, num_weights));
+    return std::unique_ptr<CMAC>(new ContinousCMAC(gen_factor, num_weights));
+}
+
+/**
+ * @brief Construct a CMAC that only provides the association of a variant and shape
+ * For models whose weights live in other storage (typed, packed, banked or shared weights):
+ * its own weight vector is released, it is used through getActiveWindows and the forEach walks.
+ *
+ * @param variant "discrete" or "continous"
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param num_weights Number of weights of the stored model
+ * @return Owning pointer to the shape model
+ */
+std::unique_ptr<CMAC> createShapeCMAC(const std::string& variant, int gen_factor, int num_weights)
+{
+    std::unique_ptr<CMAC> shape = createCMAC(variant, gen_factor, num_weights);
+    shape->releaseWeights();
+    return shape;
+}
+
+/**
+ * @brief Construct a model of the variant and shape stored in a file written by saveModel and load its weights
+ *
+ * @param path Model file path
+ * @return Owning pointer to the model (nullptr if the file could not be loaded)
+ */
+std::unique_ptr<CMAC> loadCMAC(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::streamoff file_size = file.tellg();
+    file.seekg(0);
+    char header[4 + sizeof(uint32_t) + 16];
+    int shape[2];
+    file.read(header, sizeof(header));
+    file.read((char*)shape, sizeof(shape));
+    if (!file)
+        return nullptr;
+
+    // Validate before allocating: a foreign or truncated file must not pick the model's size
+    uint32_t version;
+    memcpy(&version, header + 4, sizeof(version));
+    std::string name(header + 4 + sizeof(uint32_t), strnlen(header + 4 + sizeof(uint32_t), 16));
+    int gen_factor = shape[0], num_weights = shape[1];
+    std::streamoff expected_size = (std::streamoff)(sizeof(header) + sizeof(shape) + 2 * sizeof(float)) + (std::streamoff)num_weights * sizeof(float);
+    if (memcmp(header, "CMAC", 4) || version != 1 || (name != "DiscreteCMAC" && name != "ContinousCMAC")
+        || gen_factor < 1 || num_weights < gen_factor + 2 || file_size != expected_size)
+        return nullptr;
+
+    std::unique_ptr<CMAC> model = createCMAC(name == "DiscreteCMAC" ? "discrete" : "continous", gen_factor, num_weights);
+    if (!model->loadModel(path))
+        return nullptr;
+    return model;
+}
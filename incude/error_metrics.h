@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include "span.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CMAC_ERROR_METRICS_SSE2 1
+#endif
+
+/**
+ * @brief Error metrics between targets and predictions
+ */
+struct ErrorMetrics
+{
+    double rmse;            // Root mean squared error
+    double mae;             // Mean absolute error
+    double max_abs_error;   // Largest absolute error
+    double r2;              // Coefficient of determination (1 if the targets are constant and matched exactly, 0 if constant and missed)
+    size_t count;
+};
+
+/**
+ * @brief Kahan compensated sum
+ */
+struct KahanSum
+{
+    double sum = 0;
+    double compensation = 0;
+
+    void add(double value)
+    {
+        double y = value - compensation;
+        double t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+    }
+};
+
+ErrorMetrics computeErrorMetrics(Span<std::pair<float, float>> data, Span<std::pair<float, float>> predicted_data);
+
+//-----------------------------------------------------------
+
+#ifdef CMAC_ERROR_METRICS_SSE2
+/**
+ * @brief Kahan step on two double lanes at once
+ *
+ * @param sum Running lane sums
+ * @param compensation Running lane compensations
+ * @param value Lane values to add
+ */
+static inline void kahanAdd(__m128d& sum, __m128d& compensation, __m128d value)
+{
+    __m128d y = _mm_sub_pd(value, compensation);
+    __m128d t = _mm_add_pd(sum, y);
+    compensation = _mm_sub_pd(_mm_sub_pd(t, sum), y);
+    sum = t;
+}
+
+/**
+ * @brief Fold the lanes of a compensated SIMD accumulator into a scalar one
+ *
+ * @param total Scalar accumulator
+ * @param sum Lane sums
+ * @param compensation Lane compensations
+ */
+static inline void kahanFold(KahanSum& total, __m128d sum, __m128d compensation)
+{
+    double s[2], c[2];
+    _mm_storeu_pd(s, sum);
+    _mm_storeu_pd(c, compensation);
+    total.add(s[0]);
+    total.add(-c[0]);
+    total.add(s[1]);
+    total.add(-c[1]);
+}
+#endif
+
+/**
+ * @brief RMSE, MAE, max absolute error and R^2 of predictions in a single pass
+ * Errors are formed in float, squared and summed in double with Kahan compensation.
+ * The target moments for R^2 are taken relative to the first target to avoid cancellation.
+ *
+ * @param data Continer of the input and output data values
+ * @param predicted_data Continer of the input and output predicted data values (same order as data)
+ * @return Error metrics (all zero for an empty input)
+ */
+ErrorMetrics computeErrorMetrics(Span<std::pair<float, float>> data, Span<std::pair<float, float>> predicted_data)
+{
+    static_assert(sizeof(std::pair<float, float>) == 2 * sizeof(float), "pairs of floats must be tightly packed");
+
+    size_t n = std::min(data.size(), predicted_data.size());
+    ErrorMetrics metrics = { 0, 0, 0, 0, n };
+    if (n == 0)
+        return metrics;
+
+    const float* targets = reinterpret_cast<const float*>(data.data());
+    const float* predictions = reinterpret_cast<const float*>(predicted_data.data());
+    float shift = targets[1];
+
+    KahanSum sq_error, abs_error, target_sum, target_sq;
+    float max_abs = 0;
+    size_t i = 0;
+
+#ifdef CMAC_ERROR_METRICS_SSE2
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 shift4 = _mm_set1_ps(shift);
+    __m128d sq_s = _mm_setzero_pd(), sq_c = _mm_setzero_pd();
+    __m128d abs_s = _mm_setzero_pd(), abs_c = _mm_setzero_pd();
+    __m128d t_s = _mm_setzero_pd(), t_c = _mm_setzero_pd();
+    __m128d t2_s = _mm_setzero_pd(), t2_c = _mm_setzero_pd();
+    __m128 max4 = _mm_setzero_ps();
+
+    for (; i + 4 <= n; i += 4)
+    {
+        // (x0 y0 x1 y1) (x2 y2 x3 y3) -> (y0 y1 y2 y3)
+        __m128 t = _mm_shuffle_ps(_mm_loadu_ps(targets + 2 * i), _mm_loadu_ps(targets + 2 * i + 4), _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 p = _mm_shuffle_ps(_mm_loadu_ps(predictions + 2 * i), _mm_loadu_ps(predictions + 2 * i + 4), _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 e = _mm_andnot_ps(sign_mask, _mm_sub_ps(t, p));
+        __m128 ts = _mm_sub_ps(t, shift4);
+        max4 = _mm_max_ps(max4, e);
+
+        __m128d e_lo = _mm_cvtps_pd(e), e_hi = _mm_cvtps_pd(_mm_movehl_ps(e, e));
+        __m128d ts_lo = _mm_cvtps_pd(ts), ts_hi = _mm_cvtps_pd(_mm_movehl_ps(ts, ts));
+
+        kahanAdd(sq_s, sq_c, _mm_add_pd(_mm_mul_pd(e_lo, e_lo), _mm_mul_pd(e_hi, e_hi)));
+        kahanAdd(abs_s, abs_c, _mm_add_pd(e_lo, e_hi));
+        kahanAdd(t_s, t_c, _mm_add_pd(ts_lo, ts_hi));
+        kahanAdd(t2_s, t2_c, _mm_add_pd(_mm_mul_pd(ts_lo, ts_lo), _mm_mul_pd(ts_hi, ts_hi)));
+    }
+
+    kahanFold(sq_error, sq_s, sq_c);
+    kahanFold(abs_error, abs_s, abs_c);
+    kahanFold(target_sum, t_s, t_c);
+    kahanFold(target_sq, t2_s, t2_c);
+    float lanes[4];
+    _mm_storeu_ps(lanes, max4);
+    max_abs = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+
+    for (; i < n; i++)
+    {
+        double e = std::fabs(targets[2 * i + 1] - predictions[2 * i + 1]);
+        double ts = targets[2 * i + 1] - shift;
+        sq_error.add(e * e);
+        abs_error.add(e);
+        target_sum.add(ts);
+        target_sq.add(ts * ts);
+        max_abs = std::max(max_abs, (float)e);
+    }
+
+    double ss_res = sq_error.sum;
+    double mean_shifted = target_sum.sum / n;
+    double ss_tot = target_sq.sum - n * mean_shifted * mean_shifted;
+
+    metrics.rmse = std::sqrt(ss_res / n);
+    metrics.mae = abs_error.sum / n;
+    metrics.max_abs_error = max_abs;
+    if (ss_tot > 0)
+        metrics.r2 = 1 - ss_res / ss_tot;
+    else
+        metrics.r2 = ss_res == 0 ? 1 : 0;
+    return metrics;
+}
@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+ * @brief HDR style Latency Histogram Class
+ * Log-linear buckets: values below 64 are exact, above that every power of two
+ * is split into 32 sub buckets, so any recorded value is known to within ~3%.
+ * Recording is a bit scan and an increment, independent of the value range.
+ */
+class LatencyHistogram
+{
+private:
+    static const int sub_bits = 6;
+    static const uint64_t sub_count = 1ull << sub_bits;
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t min_value;
+    uint64_t max_value;
+    double sum;
+
+    static int highestBit(uint64_t value);
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperValue(size_t index);
+
+public:
+    LatencyHistogram();
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+    void reset();
+    uint64_t getCount() const;
+    uint64_t getMin() const;
+    uint64_t getMax() const;
+    double getMean() const;
+    uint64_t getPercentile(double percentile) const;
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the LatencyHistogram class
+ */
+LatencyHistogram::LatencyHistogram() : counts(bucketIndex(UINT64_MAX) + 1, 0)
+{
+    reset();
+}
+
+/**
+ * @brief Position of the most significant set bit
+ * @param value Non zero value
+ * @return Bit position (0 based)
+ */
+int LatencyHistogram::highestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+/**
+ * @brief Map a value to its log-linear bucket
+ * @param value Recorded value
+ * @return Bucket index
+ */
+size_t LatencyHistogram::bucketIndex(uint64_t value)
+{
+    if (value < sub_count)
+        return (size_t)value;
+    int exponent = highestBit(value) - sub_bits + 1;
+    return (size_t)(exponent * (sub_count / 2) + (value >> exponent));
+}
+
+/**
+ * @brief Largest value that maps to a bucket
+ * @param index Bucket index
+ * @return Upper bound of the bucket
+ */
+uint64_t LatencyHistogram::bucketUpperValue(size_t index)
+{
+    if (index < sub_count)
+        return index;
+    uint64_t exponent = index / (sub_count / 2) - 1;
+    uint64_t mantissa = index - exponent * (sub_count / 2);
+    return ((mantissa + 1) << exponent) - 1;
+}
+
+/**
+ * @brief Record one value
+ * @param value Value to record (e.g. latency in ns)
+ */
+void LatencyHistogram::record(uint64_t value)
+{
+    counts[bucketIndex(value)]++;
+    total++;
+    sum += (double)value;
+    min_value = std::min(min_value, value);
+    max_value = std::max(max_value, value);
+}
+
+/**
+ * @brief Add every value recorded by another histogram
+ * @param other Histogram to merge in
+ */
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < counts.size(); i++)
+        counts[i] += other.counts[i];
+    total += other.total;
+    sum += other.sum;
+    min_value = std::min(min_value, other.min_value);
+    max_value = std::max(max_value, other.max_value);
+}
+
+/**
+ * @brief Forget every recorded value
+ */
+void LatencyHistogram::reset()
+{
+    std::fill(counts.begin(), counts.end(), 0);
+    total = 0;
+    sum = 0;
+    min_value = UINT64_MAX;
+    max_value = 0;
+}
+
+/**
+ * @brief Getter to get the number of recorded values
+ * @return Count
+ */
+uint64_t LatencyHistogram::getCount() const
+{
+    return total;
+}
+
+/**
+ * @brief Getter to get the smallest recorded value
+ * @return Minimum (0 if empty)
+ */
+uint64_t LatencyHistogram::getMin() const
+{
+    return total ? min_value : 0;
+}
+
+/**
+ * @brief Getter to get the largest recorded value
+ * @return Maximum
+ */
+uint64_t LatencyHistogram::getMax() const
+{
+    return max_value;
+}
+
+/**
+ * @brief Getter to get the mean of the recorded values
+ * @return Mean (0 if empty)
+ */
+double LatencyHistogram::getMean() const
+{
+    return total ? sum / total : 0;
+}
+
+/**
+ * @brief Value below which the given percentage of recorded values fall
+ *
+ * @param percentile Percentile in [0, 100] (e.g. 99.9)
+ * @return Upper bound of the bucket holding the percentile, clamped to the observed maximum
+ */
+uint64_t LatencyHistogram::getPercentile(double percentile) const
+{
+    if (!total)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, total));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(bucketUpperValue(i), max_value);
+    }
+    return max_value;
+}
@@ -0,0 +1,691 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Local inference server answering predict requests over a unix domain socket.
+ * Clients send InferenceMessage headers followed by their input values and may pipeline
+ * requests. The server (Linux, epoll) gathers the inputs of every request that arrives
+ * within max_delay of the oldest pending one (or until max_batch inputs are pending) and
+ * answers all of them from a single predictBatch call.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <unordered_map>
+#include "cmac.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+// Writes to a closed peer must fail with EPIPE rather than raise SIGPIPE in the embedding process
+#ifndef CMAC_SEND_FLAGS
+#ifdef MSG_NOSIGNAL
+#define CMAC_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define CMAC_SEND_FLAGS 0
+#endif
+#endif
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+/**
+ * @brief Header of a request (and of its response), followed by count floats in host byte order
+ */
+struct InferenceMessage
+{
+    uint32_t id;        // Chosen by the client, echoed in the response
+    uint32_t count;     // Number of input (or output) values
+};
+
+/**
+ * @brief Counters of a server run
+ */
+struct InferenceServerStats
+{
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t points;
+    uint64_t batches;
+    uint64_t max_batch_points;
+};
+
+/**
+ * @brief Inference Server Class
+ * Single threaded epoll event loop serving one warm model to any number of local clients.
+ */
+class InferenceServer
+{
+private:
+    /**
+     * @brief Buffered state of one client connection
+     */
+    struct Connection
+    {
+        uint64_t serial;                // Distinguishes connections that reuse a closed fd
+        std::vector<char> input;
+        std::vector<char> output;
+        size_t output_sent;
+        bool want_write;
+    };
+
+    /**
+     * @brief A parsed request waiting for the next batch
+     */
+    struct PendingRequest
+    {
+        int fd;
+        uint64_t serial;
+        uint32_t id;
+        uint32_t first;                 // Offset of its inputs in the batch
+        uint32_t count;
+    };
+
+    const CMAC& model;
+    float lowerlimit;
+    float upperlimit;
+    std::string path;
+    size_t max_batch;
+    std::chrono::microseconds max_delay;
+    uint32_t max_request_points;
+
+    int listen_fd;
+    int epoll_fd;
+    int timer_fd;                       // Fires max_delay after the first request of a batch
+    uint64_t next_serial;
+    std::unordered_map<int, Connection> connections;
+    std::vector<PendingRequest> pending;
+    std::vector<float> batch_input;
+    std::vector<float> batch_output;
+    InferenceServerStats stats;
+
+    void acceptClients();
+    bool readClient(int fd, Connection& connection);
+    bool writeClient(int fd, Connection& connection);
+    void closeClient(int fd);
+    void armTimer(bool armed);
+    void flushBatch();
+
+public:
+    InferenceServer(const CMAC& model, float lowerlimit, float upperlimit, const std::string& path, size_t max_batch = 256, std::chrono::microseconds max_delay = std::chrono::microseconds(200));
+    ~InferenceServer();
+    bool start();
+    bool poll(int timeout_ms);
+    void run(const volatile sig_atomic_t& stop);
+    const InferenceServerStats& getStats() const;
+};
+
+/**
+ * @brief Inference Client Class
+ * Blocking connection to an InferenceServer.
+ */
+class InferenceClient
+{
+private:
+    int fd;
+    uint32_t next_id;
+
+    static bool readFully(int fd, void* buffer, size_t size);
+
+public:
+    InferenceClient();
+    ~InferenceClient();
+    bool connect(const std::string& path);
+    bool send(const float* x, uint32_t count, uint32_t& id);
+    bool receive(std::vector<float>& out, uint32_t& id);
+    bool predict(const float* x, uint32_t count, std::vector<float>& out);
+};
+
+//-----------------------------------------------------------
+
+#ifdef __linux__
+
+/**
+ * @brief Initialize the InferenceServer class, call start to bind the socket
+ *
+ * @param model Trained model, only read through predictBatch
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param path Unix socket path (an existing file is replaced)
+ * @param max_batch Inputs that trigger a batch immediately
+ * @param max_delay Longest time the oldest pending request waits for more to batch with
+ */
+InferenceServer::InferenceServer(const CMAC& model, float lowerlimit, float upperlimit, const std::string& path, size_t max_batch, std::chrono::microseconds max_delay) :
+    model(model), lowerlimit(lowerlimit), upperlimit(upperlimit), path(path), max_batch(max_batch), max_delay(max_delay),
+    max_request_points(65536), listen_fd(-1), epoll_fd(-1), timer_fd(-1), next_serial(0), stats()
+{
+    batch_input.reserve(max_batch);
+    batch_output.reserve(max_batch);
+}
+
+/**
+ * @brief Close every connection and remove the socket file
+ */
+InferenceServer::~InferenceServer()
+{
+    for (auto& entry : connections)
+        close(entry.first);
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+}
+
+/**
+ * @brief Bind the listening socket and create the epoll instance
+ * @return False if the socket could not be set up
+ */
+bool InferenceServer::start()
+{
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (listen_fd < 0 || path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "InferenceServer: cannot create socket " << path << std::endl;
+        return false;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 128) < 0)
+    {
+        std::cerr << "InferenceServer: cannot listen on " << path << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    // epoll_wait timeouts are whole milliseconds, the timerfd keeps sub millisecond batch delays exact
+    epoll_fd = epoll_create1(0);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_event timer_event = {};
+    timer_event.events = EPOLLIN;
+    timer_event.data.fd = timer_fd;
+    return epoll_fd >= 0 && timer_fd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == 0 &&
+           epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event) == 0;
+}
+
+/**
+ * @brief Accept every waiting client
+ */
+void InferenceServer::acceptClients()
+{
+    while (true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            continue;
+        }
+        Connection& connection = connections[fd];
+        connection = Connection();
+        connection.serial = next_serial++;
+        stats.connections++;
+    }
+}
+
+/**
+ * @brief Read what the client sent and queue its complete requests for the next batch
+ *
+ * @param fd Client socket
+ * @param connection Client state
+ * @return False if the client closed the connection or sent a malformed request
+ */
+bool InferenceServer::readClient(int fd, Connection& connection)
+{
+    char buffer[16384];
+    while (true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            connection.input.insert(connection.input.end(), buffer, buffer + n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return false;
+        if (errno != EINTR)
+            break;
+    }
+
+    size_t offset = 0;
+    while (connection.input.size() - offset >= sizeof(InferenceMessage))
+    {
+        InferenceMessage message;
+        memcpy(&message, connection.input.data() + offset, sizeof(message));
+        if (message.count > max_request_points)
+            return false;
+        size_t bytes = sizeof(message) + (size_t)message.count * sizeof(float);
+        if (connection.input.size() - offset < bytes)
+            break;
+
+        // The model indexes its weights with the input, so non finite values end the connection and the rest are clamped to the range
+        const char* values = connection.input.data() + offset + sizeof(message);
+        for (uint32_t i = 0; i < message.count; i++)
+        {
+            float x;
+            memcpy(&x, values + i * sizeof(float), sizeof(float));
+            if (!std::isfinite(x))
+                return false;
+        }
+
+        if (pending.empty())
+            armTimer(true);
+        size_t first = batch_input.size();
+        batch_input.resize(first + message.count);
+        memcpy(batch_input.data() + first, values, message.count * sizeof(float));
+        for (size_t i = first; i < batch_input.size(); i++)
+            batch_input[i] = std::min(std::max(batch_input[i], lowerlimit), upperlimit);
+        pending.push_back({ fd, connection.serial, message.id, (uint32_t)first, message.count });
+        offset += bytes;
+    }
+    connection.input.erase(connection.input.begin(), connection.input.begin() + offset);
+    return true;
+}
+
+/**
+ * @brief Send as much of the buffered output as the socket takes, waiting for EPOLLOUT if it is full
+ *
+ * @param fd Client socket
+ * @param connection Client state
+ * @return False if the connection failed
+ */
+bool InferenceServer::writeClient(int fd, Connection& connection)
+{
+    while (connection.output_sent < connection.output.size())
+    {
+        ssize_t n = ::send(fd, connection.output.data() + connection.output_sent, connection.output.size() - connection.output_sent, CMAC_SEND_FLAGS);
+        if (n > 0)
+            connection.output_sent += n;
+        else if (errno == EINTR)
+            continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else
+            return false;
+    }
+
+    bool want_write = connection.output_sent < connection.output.size();
+    if (!want_write)
+    {
+        connection.output.clear();
+        connection.output_sent = 0;
+    }
+    if (want_write != connection.want_write)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : 0u);
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+        connection.want_write = want_write;
+    }
+    return true;
+}
+
+/**
+ * @brief Drop a client, its pending requests are skipped when the batch is answered
+ * @param fd Client socket
+ */
+void InferenceServer::closeClient(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+/**
+ * @brief Start the batch delay timer, or stop it once the batch was answered early
+ * @param armed True to fire after max_delay
+ */
+void InferenceServer::armTimer(bool armed)
+{
+    itimerspec spec = {};
+    if (armed)
+    {
+        long long delay_ns = std::max<long long>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(max_delay).count());
+        spec.it_value.tv_sec = delay_ns / 1000000000;
+        spec.it_value.tv_nsec = delay_ns % 1000000000;
+    }
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+/**
+ * @brief Predict every pending input in one batch and queue the responses
+ */
+void InferenceServer::flushBatch()
+{
+    if (pending.empty())
+        return;
+    batch_output.resize(batch_input.size());
+    model.predictBatch(batch_input.data(), batch_output.data(), batch_input.size(), lowerlimit, upperlimit);
+    stats.batches++;
+    stats.requests += pending.size();
+    stats.points += batch_input.size();
+    stats.max_batch_points = std::max<uint64_t>(stats.max_batch_points, batch_input.size());
+
+    for (const PendingRequest& request : pending)
+    {
+        auto it = connections.find(request.fd);
+        if (it == connections.end() || it->second.serial != request.serial)
+            continue;
+        std::vector<char>& output = it->second.output;
+        InferenceMessage message = { request.id, request.count };
+        size_t offset = output.size();
+        output.resize(offset + sizeof(message) + request.count * sizeof(float));
+        memcpy(output.data() + offset, &message, sizeof(message));
+        memcpy(output.data() + offset + sizeof(message), batch_output.data() + request.first, request.count * sizeof(float));
+    }
+
+    // Responses of one batch go out together, one write per connection
+    for (const PendingRequest& request : pending)
+    {
+        auto it = connections.find(request.fd);
+        if (it != connections.end() && it->second.serial == request.serial && !it->second.want_write && !writeClient(request.fd, it->second))
+            closeClient(request.fd);
+    }
+    pending.clear();
+    batch_input.clear();
+    armTimer(false);
+}
+
+/**
+ * @brief Wait for socket events and answer the pending batch once it is full or old enough
+ * @param timeout_ms Longest wait for an event (-1 blocks)
+ * @return False if epoll failed
+ */
+bool InferenceServer::poll(int timeout_ms)
+{
+    epoll_event events[64];
+    int ready = epoll_wait(epoll_fd, events, 64, timeout_ms);
+    if (ready < 0 && errno != EINTR)
+        return false;
+
+    for (int i = 0; i < ready; i++)
+    {
+        int fd = events[i].data.fd;
+        if (fd == listen_fd)
+        {
+            acceptClients();
+            continue;
+        }
+        if (fd == timer_fd)
+        {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) > 0)
+                flushBatch();
+            continue;
+        }
+        auto it = connections.find(fd);
+        if (it == connections.end())
+            continue;
+        bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP)) || (events[i].events & EPOLLIN);
+        if (ok && (events[i].events & EPOLLIN))
+            ok = readClient(fd, it->second);
+        if (ok && (events[i].events & EPOLLOUT))
+            ok = writeClient(fd, it->second);
+        if (!ok)
+            closeClient(fd);
+
+        if (batch_input.size() >= max_batch)
+            flushBatch();
+    }
+    return true;
+}
+
+/**
+ * @brief Serve until stop is set (e.g. from a signal handler)
+ * @param stop Stop flag, checked at least every 100 ms
+ */
+void InferenceServer::run(const volatile sig_atomic_t& stop)
+{
+    while (!stop && poll(100))
+        ;
+    flushBatch();
+}
+
+#else
+
+InferenceServer::InferenceServer(const CMAC& model, float lowerlimit, float upperlimit, const std::string& path, size_t max_batch, std::chrono::microseconds max_delay) :
+    model(model), lowerlimit(lowerlimit), upperlimit(upperlimit), path(path), max_batch(max_batch), max_delay(max_delay),
+    max_request_points(0), listen_fd(-1), epoll_fd(-1), timer_fd(-1), next_serial(0), stats() {};
+
+InferenceServer::~InferenceServer() {};
+
+/**
+ * @brief The event loop needs epoll, not available on this platform
+ * @return False
+ */
+bool InferenceServer::start()
+{
+    std::cerr << "InferenceServer: epoll is not supported on this platform" << std::endl;
+    return false;
+}
+
+/**
+ * @brief The event loop needs epoll, not available on this platform
+ * @return False
+ */
+bool InferenceServer::poll(int)
+{
+    return false;
+}
+
+/**
+ * @brief The event loop needs epoll, not available on this platform
+ */
+void InferenceServer::run(const volatile sig_atomic_t&) {};
+
+#endif
+
+/**
+ * @brief Getter to get the counters of this server
+ * @return Server counters
+ */
+const InferenceServerStats& InferenceServer::getStats() const
+{
+    return stats;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/**
+ * @brief Initialize the InferenceClient class, call connect before use
+ */
+InferenceClient::InferenceClient() : fd(-1), next_id(0) {};
+
+/**
+ * @brief Close the connection
+ */
+InferenceClient::~InferenceClient()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+/**
+ * @brief Connect to a server socket
+ * @param path Unix socket path
+ * @return False if the server is not reachable
+ */
+bool InferenceClient::connect(const std::string& path)
+{
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    if (fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return fd >= 0 && ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+/**
+ * @brief Send one request without waiting for its response (requests may be pipelined)
+ *
+ * @param x Input values
+ * @param count Number of inputs
+ * @param id Receives the request id
+ * @return False if the connection failed
+ */
+bool InferenceClient::send(const float* x, uint32_t count, uint32_t& id)
+{
+    id = next_id++;
+    InferenceMessage message = { id, count };
+    std::vector<char> buffer(sizeof(message) + count * sizeof(float));
+    memcpy(buffer.data(), &message, sizeof(message));
+    memcpy(buffer.data() + sizeof(message), x, count * sizeof(float));
+
+    size_t sent = 0;
+    while (sent < buffer.size())
+    {
+        ssize_t n = ::send(fd, buffer.data() + sent, buffer.size() - sent, CMAC_SEND_FLAGS);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Read bytes until the buffer is full
+ *
+ * @param fd Socket
+ * @param buffer Destination
+ * @param size Bytes to read
+ * @return False if the connection closed first
+ */
+bool InferenceClient::readFully(int fd, void* buffer, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t n = read(fd, (char*)buffer + received, size - received);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        received += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Wait for the next response (responses arrive in request order)
+ *
+ * @param out Receives the predicted output values
+ * @param id Receives the id of the answered request
+ * @return False if the connection failed
+ */
+bool InferenceClient::receive(std::vector<float>& out, uint32_t& id)
+{
+    InferenceMessage message;
+    if (!readFully(fd, &message, sizeof(message)))
+        return false;
+    id = message.id;
+    out.resize(message.count);
+    return readFully(fd, out.data(), message.count * sizeof(float));
+}
+
+/**
+ * @brief Send one request and wait for its response
+ *
+ * @param x Input values
+ * @param count Number of inputs
+ * @param out Receives the predicted output values
+ * @return False if the connection failed
+ */
+bool InferenceClient::predict(const float* x, uint32_t count, std::vector<float>& out)
+{
+    uint32_t id, answered;
+    return send(x, count, id) && receive(out, answered) && answered == id;
+}
+
+#else
+
+InferenceClient::InferenceClient() : fd(-1), next_id(0) {};
+
+InferenceClient::~InferenceClient() {};
+
+/**
+ * @brief Unix domain sockets are not available on this platform
+ * @return False
+ */
+bool InferenceClient::connect(const std::string&)
+{
+    return false;
+}
+
+/**
+ * @brief Unix domain sockets are not available on this platform
+ * @return False
+ */
+bool InferenceClient::send(const float*, uint32_t, uint32_t&)
+{
+    return false;
+}
+
+/**
+ * @brief Unix domain sockets are not available on this platform
+ * @return False
+ */
+bool InferenceClient::receive(std::vector<float>&, uint32_t&)
+{
+    return false;
+}
+
+/**
+ * @brief Unix domain sockets are not available on this platform
+ * @return False
+ */
+bool InferenceClient::predict(const float*, uint32_t, std::vector<float>&)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Learning rate schedules applied per epoch by CMAC::trainEpochs.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+/**
+ * @brief Available learning rate schedules
+ */
+enum ScheduleType
+{
+    SCHEDULE_CONSTANT = 0,      // lr every epoch
+    SCHEDULE_STEP,              // lr * gamma^(epoch / step_epochs)
+    SCHEDULE_COSINE,            // Cosine annealing from lr to min_lr over period_epochs
+    SCHEDULE_INVERSE_TIME,      // lr / (1 + decay * epoch)
+    SCHEDULE_AUTO               // Stable step from the activation gain, adapted to the loss trend
+};
+
+/**
+ * @brief Learning Rate Schedule Class
+ * Maps the epoch number (and for SCHEDULE_AUTO the loss history) to the learning rate of the next epoch.
+ */
+class LearningRateSchedule
+{
+private:
+    ScheduleType type;
+    int step_epochs;
+    float gamma;
+    int period_epochs;
+    float min_lr;
+    float decay;
+
+    // SCHEDULE_AUTO state
+    float max_lr;
+    float auto_lr;
+    float prev_loss;
+
+public:
+    LearningRateSchedule(ScheduleType type);
+    static LearningRateSchedule constant();
+    static LearningRateSchedule step(int step_epochs, float gamma);
+    static LearningRateSchedule cosine(int period_epochs, float min_lr);
+    static LearningRateSchedule inverseTime(float decay);
+    static LearningRateSchedule automatic();
+    ScheduleType getType() const;
+    void reset(float activation_gain);
+    float rate(int epoch, float lr, float loss);
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the LearningRateSchedule class with default parameters
+ * @param type Schedule type
+ */
+LearningRateSchedule::LearningRateSchedule(ScheduleType type) : type(type), step_epochs(100), gamma(0.5), period_epochs(1000), min_lr(0),
+    decay(0.01), max_lr(1), auto_lr(0.5), prev_loss(0) {};
+
+/**
+ * @brief Fixed learning rate (the behaviour before schedules existed)
+ * @return Schedule
+ */
+LearningRateSchedule LearningRateSchedule::constant()
+{
+    return LearningRateSchedule(SCHEDULE_CONSTANT);
+}
+
+/**
+ * @brief Multiply the learning rate by gamma every step_epochs epochs
+ *
+ * @param step_epochs Epochs between decays
+ * @param gamma Decay factor
+ * @return Schedule
+ */
+LearningRateSchedule LearningRateSchedule::step(int step_epochs, float gamma)
+{
+    LearningRateSchedule schedule(SCHEDULE_STEP);
+    schedule.step_epochs = std::max(1, step_epochs);
+    schedule.gamma = gamma;
+    return schedule;
+}
+
+/**
+ * @brief Cosine annealing from the learning rate down to min_lr, held at min_lr afterwards
+ *
+ * @param period_epochs Epochs of the annealing
+ * @param min_lr Final learning rate
+ * @return Schedule
+ */
+LearningRateSchedule LearningRateSchedule::cosine(int period_epochs, float min_lr)
+{
+    LearningRateSchedule schedule(SCHEDULE_COSINE);
+    schedule.period_epochs = std::max(1, period_epochs);
+    schedule.min_lr = min_lr;
+    return schedule;
+}
+
+/**
+ * @brief Learning rate divided by (1 + decay * epoch)
+ *
+ * @param decay Decay per epoch
+ * @return Schedule
+ */
+LearningRateSchedule LearningRateSchedule::inverseTime(float decay)
+{
+    LearningRateSchedule schedule(SCHEDULE_INVERSE_TIME);
+    schedule.decay = decay;
+    return schedule;
+}
+
+/**
+ * @brief Automatic step size, the learning rate passed to training is ignored
+ * Starts at half the largest stable step and follows the loss trend (bold driver):
+ * grows by 5% while the loss falls and halves when it rises.
+ *
+ * @return Schedule
+ */
+LearningRateSchedule LearningRateSchedule::automatic()
+{
+    return LearningRateSchedule(SCHEDULE_AUTO);
+}
+
+/**
+ * @brief Getter to get the Schedule Type
+ * @return Schedule type
+ */
+ScheduleType LearningRateSchedule::getType() const
+{
+    return type;
+}
+
+/**
+ * @brief Start a new training run
+ * With every active cell corrected by lr * error / gen_factor, one update moves the prediction of the
+ * sample itself by lr * error * activation_gain, so the sample error is fully corrected at
+ * lr = 1 / activation_gain and steps beyond twice that diverge.
+ *
+ * @param activation_gain Change of the sample prediction per unit of lr * error
+ */
+void LearningRateSchedule::reset(float activation_gain)
+{
+    max_lr = 1 / std::max(activation_gain, 1e-6f);
+    auto_lr = 0.5f * max_lr;
+    prev_loss = 0;
+}
+
+/**
+ * @brief Learning rate for the next epoch
+ *
+ * @param epoch Number of epochs completed
+ * @param lr Base learning rate passed to training
+ * @param loss Training loss after the last epoch (ignored before the first epoch)
+ * @return Learning rate
+ */
+float LearningRateSchedule::rate(int epoch, float lr, float loss)
+{
+    switch (type)
+    {
+    case SCHEDULE_STEP:
+        return lr * std::pow(gamma, (float)(epoch / step_epochs));
+    case SCHEDULE_COSINE:
+    {
+        float t = std::min(1.0f, (float)epoch / period_epochs);
+        return min_lr + 0.5f * (lr - min_lr) * (1 + std::cos(3.14159265f * t));
+    }
+    case SCHEDULE_INVERSE_TIME:
+        return lr / (1 + decay * epoch);
+    case SCHEDULE_AUTO:
+        if (epoch > 0 && prev_loss > 0)
+        {
+            if (loss < prev_loss)
+                auto_lr = std::min(max_lr, auto_lr * 1.05f);
+            else if (loss > prev_loss)
+                auto_lr *= 0.5f;
+        }
+        if (epoch > 0)
+            prev_loss = loss;
+        return auto_lr;
+    default:
+        return lr;
+    }
+}
@@ -0,0 +1,535 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+// Writes to a closed peer must fail with EPIPE rather than raise SIGPIPE in the embedding process
+#ifndef CMAC_SEND_FLAGS
+#ifdef MSG_NOSIGNAL
+#define CMAC_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define CMAC_SEND_FLAGS 0
+#endif
+#endif
+#endif
+
+/**
+ * @brief Monotonic Counter Class
+ * Sharded over cache line padded slots so that many serving threads can count without
+ * bouncing one cache line; reading sums the shards.
+ */
+class Counter
+{
+private:
+    static const int shard_count = 16;
+    // Padded rather than alignas(64): heap allocating an over-aligned type needs C++17 aligned new.
+    // Values 64 bytes apart never share a line even when the counter itself is not line aligned.
+    struct Shard
+    {
+        std::atomic<uint64_t> value{ 0 };
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    Shard shards[shard_count];
+
+    static int shardIndex();
+
+public:
+    void add(uint64_t n = 1);
+    uint64_t get() const;
+};
+
+/**
+ * @brief Gauge Class holding the last value set
+ */
+class Gauge
+{
+private:
+    std::atomic<double> value{ 0 };
+
+public:
+    void set(double v);
+    double get() const;
+};
+
+/**
+ * @brief Histogram Class with fixed cumulative buckets (Prometheus semantics)
+ */
+class Histogram
+{
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<double> sum{ 0 };
+
+public:
+    Histogram(std::vector<double> bounds);
+    void observe(double v);
+    void write(std::ostream& out, const std::string& name, const std::string& labels) const;
+};
+
+/**
+ * @brief Metrics Registry Class
+ * Owns the metrics and renders them in the Prometheus text exposition format.
+ */
+class MetricsRegistry
+{
+private:
+    enum class Type { CounterType, GaugeType, HistogramType };
+    struct Entry
+    {
+        std::string name;
+        std::string labels;     // e.g. model="DiscreteCMAC" (without braces)
+        std::string help;
+        Type type;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Entry>> entries;
+
+    Entry& add(const std::string& name, const std::string& labels, const std::string& help, Type type);
+
+public:
+    Counter& counter(const std::string& name, const std::string& labels, const std::string& help);
+    Gauge& gauge(const std::string& name, const std::string& labels, const std::string& help);
+    Histogram& histogram(const std::string& name, const std::string& labels, const std::string& help, std::vector<double> bounds);
+    std::string expose() const;
+    bool writeToFile(const std::string& path) const;
+};
+
+/**
+ * @brief Metrics Exporter Class
+ * Background thread that either rewrites a snapshot file every interval (e.g. for the
+ * node_exporter textfile collector) or answers every connection on a local unix socket
+ * with an HTTP response carrying the snapshot (curl --unix-socket path http://localhost/metrics).
+ */
+class MetricsExporter
+{
+private:
+    const MetricsRegistry& registry;
+    std::string path;
+    bool use_socket;
+    std::chrono::milliseconds interval;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    void fileLoop();
+    void socketLoop();
+
+public:
+    MetricsExporter(const MetricsRegistry& registry, std::string path, bool use_socket, std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+    ~MetricsExporter();
+    void stop();
+};
+
+/**
+ * @brief Metrics published by one CMAC model
+ */
+struct CMACMetrics
+{
+    Counter& samples_learned;
+    Counter& queries_served;
+    Histogram& update_latency;  // Mean per sample update latency of each pass, in seconds
+    Gauge& rmse;
+    Gauge& weight_norm;
+
+    CMACMetrics(MetricsRegistry& registry, const std::string& model);
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Shard used by the calling thread
+ * @return Shard index
+ */
+int Counter::shardIndex()
+{
+    static std::atomic<int> next_thread{ 0 };
+    thread_local int index = next_thread.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    return index;
+}
+
+/**
+ * @brief Increase the counter
+ * @param n Increment
+ */
+void Counter::add(uint64_t n)
+{
+    shards[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Getter to get the counter value
+ * @return Sum over all shards
+ */
+uint64_t Counter::get() const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < shard_count; i++)
+        total += shards[i].value.load(std::memory_order_relaxed);
+    return total;
+}
+
+/**
+ * @brief Setter to set the gauge
+ * @param v New value
+ */
+void Gauge::set(double v)
+{
+    value.store(v, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Getter to get the gauge
+ * @return Last value set
+ */
+double Gauge::get() const
+{
+    return value.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Initialize the Histogram class
+ * @param bounds Ascending upper bounds of the buckets (+Inf is implicit)
+ */
+Histogram::Histogram(std::vector<double> bounds) : bounds(bounds), buckets(new std::atomic<uint64_t>[bounds.size() + 1])
+{
+    for (size_t i = 0; i <= bounds.size(); i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Record one observation
+ * @param v Observed value
+ */
+void Histogram::observe(double v)
+{
+    size_t i = 0;
+    while (i < bounds.size() && v > bounds[i])
+        i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    double current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + v, std::memory_order_relaxed))
+        ;
+}
+
+/**
+ * @brief Write the bucket, sum and count samples
+ *
+ * @param out Output stream
+ * @param name Metric name
+ * @param labels Label pairs without braces (may be empty)
+ */
+void Histogram::write(std::ostream& out, const std::string& name, const std::string& labels) const
+{
+    std::string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= bounds.size(); i++)
+    {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        out << name << "_bucket{" << labels << sep << "le=\"";
+        if (i < bounds.size())
+            out << bounds[i];
+        else
+            out << "+Inf";
+        out << "\"} " << cumulative << '\n';
+    }
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braces << ' ' << sum.load(std::memory_order_relaxed) << '\n';
+    out << name << "_count" << braces << ' ' << count.load(std::memory_order_relaxed) << '\n';
+}
+
+/**
+ * @brief Register a new metric
+ *
+ * @param name Metric name
+ * @param labels Label pairs without braces
+ * @param help Help text
+ * @param type Metric type
+ * @return New entry
+ */
+MetricsRegistry::Entry& MetricsRegistry::add(const std::string& name, const std::string& labels, const std::string& help, Type type)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.emplace_back(new Entry());
+    Entry& entry = *entries.back();
+    entry.name = name;
+    entry.labels = labels;
+    entry.help = help;
+    entry.type = type;
+    return entry;
+}
+
+/**
+ * @brief Register a counter
+ *
+ * @param name Metric name
+ * @param labels Label pairs without braces
+ * @param help Help text
+ * @return Counter owned by the registry
+ */
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& labels, const std::string& help)
+{
+    Entry& entry = add(name, labels, help, Type::CounterType);
+    entry.counter.reset(new Counter());
+    return *entry.counter;
+}
+
+/**
+ * @brief Register a gauge
+ *
+ * @param name Metric name
+ * @param labels Label pairs without braces
+ * @param help Help text
+ * @return Gauge owned by the registry
+ */
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& labels, const std::string& help)
+{
+    Entry& entry = add(name, labels, help, Type::GaugeType);
+    entry.gauge.reset(new Gauge());
+    return *entry.gauge;
+}
+
+/**
+ * @brief Register a histogram
+ *
+ * @param name Metric name
+ * @param labels Label pairs without braces
+ * @param help Help text
+ * @param bounds Ascending bucket upper bounds
+ * @return Histogram owned by the registry
+ */
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& labels, const std::string& help, std::vector<double> bounds)
+{
+    Entry& entry = add(name, labels, help, Type::HistogramType);
+    entry.histogram.reset(new Histogram(bounds));
+    return *entry.histogram;
+}
+
+/**
+ * @brief Render every metric in the Prometheus text exposition format
+ * @return Snapshot text
+ */
+std::string MetricsRegistry::expose() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    std::vector<bool> written(entries.size(), false);
+
+    // Samples of one metric family must be contiguous, so group entries by name
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (written[i])
+            continue;
+        const Entry& family = *entries[i];
+        const char* type = family.type == Type::CounterType ? "counter" : (family.type == Type::GaugeType ? "gauge" : "histogram");
+        out << "# HELP " << family.name << ' ' << family.help << '\n';
+        out << "# TYPE " << family.name << ' ' << type << '\n';
+
+        for (size_t j = i; j < entries.size(); j++)
+        {
+            const Entry& entry = *entries[j];
+            if (written[j] || entry.name != family.name)
+                continue;
+            written[j] = true;
+
+            std::string braces = entry.labels.empty() ? "" : "{" + entry.labels + "}";
+            if (entry.type == Type::CounterType)
+                out << entry.name << braces << ' ' << entry.counter->get() << '\n';
+            else if (entry.type == Type::GaugeType)
+                out << entry.name << braces << ' ' << entry.gauge->get() << '\n';
+            else
+                entry.histogram->write(out, entry.name, entry.labels);
+        }
+    }
+    return out.str();
+}
+
+/**
+ * @brief Atomically replace a file with the current snapshot
+ * @param path Output file path
+ * @return True if the snapshot was written
+ */
+bool MetricsRegistry::writeToFile(const std::string& path) const
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp);
+        if (!file)
+            return false;
+        file << expose();
+        if (!file)
+            return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the MetricsExporter class and start its thread
+ *
+ * @param registry Registry to export
+ * @param path Snapshot file path, or unix socket path if use_socket is set
+ * @param use_socket Serve on a unix socket instead of rewriting a file
+ * @param interval File rewrite interval
+ */
+MetricsExporter::MetricsExporter(const MetricsRegistry& registry, std::string path, bool use_socket, std::chrono::milliseconds interval) : registry(registry), path(path), use_socket(use_socket), interval(interval), running(true)
+{
+    if (use_socket)
+        worker = std::thread(&MetricsExporter::socketLoop, this);
+    else
+        worker = std::thread(&MetricsExporter::fileLoop, this);
+}
+
+/**
+ * @brief Stop the exporter thread
+ */
+MetricsExporter::~MetricsExporter()
+{
+    stop();
+}
+
+/**
+ * @brief Stop the exporter thread (writes a final snapshot in file mode)
+ */
+void MetricsExporter::stop()
+{
+    if (!running.exchange(false))
+        return;
+    if (worker.joinable())
+        worker.join();
+}
+
+/**
+ * @brief Rewrite the snapshot file every interval
+ */
+void MetricsExporter::fileLoop()
+{
+    auto next = std::chrono::steady_clock::now();
+    while (running.load(std::memory_order_acquire))
+    {
+        if (std::chrono::steady_clock::now() >= next)
+        {
+            registry.writeToFile(path);
+            next += interval;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    registry.writeToFile(path);
+}
+
+/**
+ * @brief Answer every connection on the unix socket with the current snapshot
+ */
+void MetricsExporter::socketLoop()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (server < 0 || path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "MetricsExporter: cannot create socket " << path << std::endl;
+        return;
+    }
+    path.copy(addr.sun_path, path.size());
+    unlink(path.c_str());
+    if (bind(server, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(server, 16) < 0)
+    {
+        std::cerr << "MetricsExporter: cannot listen on " << path << std::endl;
+        close(server);
+        return;
+    }
+
+    while (running.load(std::memory_order_acquire))
+    {
+        pollfd pfd = { server, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+            continue;
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+        // The request itself is not inspected: every connection gets the snapshot
+        char request[1024];
+        pollfd cfd = { client, POLLIN, 0 };
+        if (poll(&cfd, 1, 100) > 0)
+            (void)!read(client, request, sizeof(request));
+
+        std::string body = registry.expose();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, CMAC_SEND_FLAGS);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        close(client);
+    }
+    close(server);
+    unlink(path.c_str());
+#else
+    std::cerr << "MetricsExporter: unix sockets are not supported on this platform" << std::endl;
+#endif
+}
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Register the metrics of one model
+ *
+ * @param registry Registry owning the metrics
+ * @param model Model name used as the "model" label
+ */
+CMACMetrics::CMACMetrics(MetricsRegistry& registry, const std::string& model) :
+    samples_learned(registry.counter("cmac_samples_learned_total", "model=\"" + model + "\"", "Training samples applied to the weights")),
+    queries_served(registry.counter("cmac_queries_served_total", "model=\"" + model + "\"", "Inference queries answered")),
+    update_latency(registry.histogram("cmac_update_latency_seconds", "model=\"" + model + "\"", "Mean per sample weight update latency of each training pass",
+        { 1e-8, 2.5e-8, 5e-8, 1e-7, 2.5e-7, 5e-7, 1e-6, 2.5e-6, 5e-6, 1e-5 })),
+    rmse(registry.gauge("cmac_rmse", "model=\"" + model + "\"", "Training error after the last epoch")),
+    weight_norm(registry.gauge("cmac_weight_norm", "model=\"" + model + "\"", "L2 norm of the weight vector after the last epoch")) {};
@@ -0,0 +1,302 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Bank of many same shaped CMACs (one per joint, task, ...) in one contiguous arena.
+ * The weights are stored structure of arrays: row c holds cell c of every model, padded to a
+ * whole number of cache lines. All models share the variant, shape and input limits, so for a
+ * given input they share the active cells, and evaluating or updating every model streams
+ * through gen_factor (continous: 2 * gen_factor) contiguous rows with SIMD.
+ * Updates distribute the error uniformly over the active cells (UPDATE_UNIFORM).
+ */
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "cmac.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CMAC_MODEL_BANK_SSE2 1
+#endif
+
+/**
+ * @brief Model Bank Class
+ * Owns the weights of num_models models of one shape, evaluated and trained per model or all at once.
+ */
+class ModelBank
+{
+private:
+    std::unique_ptr<CMAC> shape;        // Shared by every model of the bank
+    int num_models;
+    int num_weights;
+    int gen_factor;
+    size_t stride;                      // Floats per row, num_models rounded up to a cache line
+    float lowerlimit;
+    float upperlimit;
+    float* weights;                     // num_weights rows of stride floats, 64 byte aligned
+    HugePages huge_pages;
+
+    static constexpr size_t line_floats = cache_line_size / sizeof(float);
+
+    void sumLine(const ActiveWindows& windows, size_t first, float* line) const;
+
+public:
+    ModelBank(const std::string& variant, int num_models, int gen_factor, int num_weights, float lowerlimit, float upperlimit, HugePages huge_pages);
+    ~ModelBank();
+    ModelBank(const ModelBank&) = delete;
+    ModelBank& operator=(const ModelBank&) = delete;
+    int getNumModels() const;
+    int getNumWeights() const;
+    size_t getStride() const;
+    size_t getArenaBytes() const;
+    const CMAC& getShape() const;
+    void importModel(int model, const CMAC& source);
+    void exportModel(int model, std::vector<float>& out) const;
+    float predict(int model, float x) const;
+    void predictAll(float x, float* out) const;
+    void learn(int model, std::pair<float, float> data_element, float lr);
+    void learnAll(float x, const float* targets, float lr);
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the ModelBank class with every weight at 1, like a fresh CMAC
+ *
+ * @param variant "discrete" or "continous"
+ * @param num_models Number of models in the bank
+ * @param gen_factor Generalization Factor of every model
+ * @param num_weights Number of weights of every model
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param huge_pages Page backing of the arena
+ */
+ModelBank::ModelBank(const std::string& variant, int num_models, int gen_factor, int num_weights, float lowerlimit, float upperlimit,
+                     HugePages huge_pages = HUGE_PAGES_OFF) :
+    shape(createShapeCMAC(variant, gen_factor, num_weights)), num_models(num_models), num_weights(num_weights), gen_factor(gen_factor),
+    lowerlimit(lowerlimit), upperlimit(upperlimit), huge_pages(huge_pages)
+{
+    stride = (num_models + line_floats - 1) / line_floats * line_floats;
+    weights = (float*)allocateAligned(getArenaBytes(), huge_pages);
+    for (size_t i = 0; i < (size_t)num_weights * stride; i++)
+        weights[i] = 1;
+}
+
+/**
+ * @brief Free the arena
+ */
+ModelBank::~ModelBank()
+{
+    freeAligned(weights, getArenaBytes(), huge_pages);
+}
+
+/**
+ * @brief Getter to get the number of models
+ * @return Number of models
+ */
+int ModelBank::getNumModels() const
+{
+    return num_models;
+}
+
+/**
+ * @brief Getter to get the number of weights of every model
+ * @return Number of weights
+ */
+int ModelBank::getNumWeights() const
+{
+    return num_weights;
+}
+
+/**
+ * @brief Getter to get the distance in floats between cell c and cell c + 1 of a model
+ * @return Row stride
+ */
+size_t ModelBank::getStride() const
+{
+    return stride;
+}
+
+/**
+ * @brief Getter to get the size of the arena, the only per model storage of the bank
+ * @return Bytes
+ */
+size_t ModelBank::getArenaBytes() const
+{
+    return (size_t)num_weights * stride * sizeof(float);
+}
+
+/**
+ * @brief Getter to get the shape model (variant, gen_factor, num_weights)
+ * @return Shape model, it holds no weights
+ */
+const CMAC& ModelBank::getShape() const
+{
+    return *shape;
+}
+
+/**
+ * @brief Copy the weights of a trained CMAC of the same shape into one model of the bank
+ *
+ * @param model Model index
+ * @param source CMAC of the bank's variant and shape
+ */
+void ModelBank::importModel(int model, const CMAC& source)
+{
+    source.forEachWeight([&](size_t c, float w) { weights[c * stride + model] = w; });
+}
+
+/**
+ * @brief Copy the weights of one model out of the bank
+ *
+ * @param model Model index
+ * @param out Receives num_weights weights
+ */
+void ModelBank::exportModel(int model, std::vector<float>& out) const
+{
+    out.resize(num_weights);
+    for (int c = 0; c < num_weights; c++)
+        out[c] = weights[c * stride + model];
+}
+
+/**
+ * @brief Predict one model's output (same result as predictPoint on that model)
+ *
+ * @param model Model index
+ * @param x Input value
+ * @return Predicted output value
+ */
+float ModelBank::predict(int model, float x) const
+{
+    float res = 0;
+    shape->forEachActiveCell(x, lowerlimit, upperlimit, [&](int c, float share) { res += weights[c * stride + model] * share; });
+    return res;
+}
+
+/**
+ * @brief Predictions of the 16 models of one cache line column, accumulated in registers over the active rows
+ *
+ * @param windows Active cells of the input
+ * @param first First model of the column (multiple of 16)
+ * @param line Receives 16 predictions (64 byte aligned)
+ */
+void ModelBank::sumLine(const ActiveWindows& windows, size_t first, float* line) const
+{
+#ifdef CMAC_MODEL_BANK_SSE2
+    __m128 res0 = _mm_setzero_ps(), res1 = _mm_setzero_ps(), res2 = _mm_setzero_ps(), res3 = _mm_setzero_ps();
+    for (int w = 0; w < windows.count; w++)
+    {
+        __m128 share = _mm_set1_ps(windows.share[w]);
+        const float* row = weights + windows.start[w] * stride + first;
+        for (int c = 0; c < gen_factor; c++, row += stride)
+        {
+            res0 = _mm_add_ps(res0, _mm_mul_ps(_mm_load_ps(row), share));
+            res1 = _mm_add_ps(res1, _mm_mul_ps(_mm_load_ps(row + 4), share));
+            res2 = _mm_add_ps(res2, _mm_mul_ps(_mm_load_ps(row + 8), share));
+            res3 = _mm_add_ps(res3, _mm_mul_ps(_mm_load_ps(row + 12), share));
+        }
+    }
+    _mm_store_ps(line, res0);
+    _mm_store_ps(line + 4, res1);
+    _mm_store_ps(line + 8, res2);
+    _mm_store_ps(line + 12, res3);
+#else
+    std::fill(line, line + line_floats, 0.0f);
+    for (int w = 0; w < windows.count; w++)
+    {
+        const float* row = weights + windows.start[w] * stride + first;
+        for (int c = 0; c < gen_factor; c++, row += stride)
+            for (size_t j = 0; j < line_floats; j++)
+                line[j] += row[j] * windows.share[w];
+    }
+#endif
+}
+
+/**
+ * @brief Predict the output of every model for one input in a single sweep over the active rows
+ *
+ * @param x Input value
+ * @param out Receives getNumModels() outputs
+ */
+void ModelBank::predictAll(float x, float* out) const
+{
+    ActiveWindows windows = shape->getActiveWindows(x, lowerlimit, upperlimit);
+    alignas(64) float line[line_floats];
+    for (size_t first = 0; first < stride; first += line_floats)
+    {
+        sumLine(windows, first, line);
+        std::copy(line, line + std::min(line_floats, num_models - first), out + first);
+    }
+}
+
+/**
+ * @brief Online update of one model for one sample (same result as learnSample on that model)
+ *
+ * @param model Model index
+ * @param data_element Pair of the input and output data value
+ * @param lr Learning Rate for training
+ */
+void ModelBank::learn(int model, std::pair<float, float> data_element, float lr)
+{
+    float error = data_element.second - predict(model, data_element.first);
+    float correction = (lr * error) / gen_factor;
+    shape->forEachActiveCell(data_element.first, lowerlimit, upperlimit, [&](int c, float) { weights[c * stride + model] += correction; });
+}
+
+/**
+ * @brief Online update of every model for one input, each towards its own target
+ * Every cache line column is read once for the predictions and updated while it is still in L1.
+ *
+ * @param x Input value
+ * @param targets getNumModels() target outputs
+ * @param lr Learning Rate for training
+ */
+void ModelBank::learnAll(float x, const float* targets, float lr)
+{
+    ActiveWindows windows = shape->getActiveWindows(x, lowerlimit, upperlimit);
+    alignas(64) float line[line_floats];
+    for (size_t first = 0; first < stride; first += line_floats)
+    {
+        sumLine(windows, first, line);
+        size_t valid = std::min(line_floats, num_models - first);
+        for (size_t j = 0; j < line_floats; j++)
+            line[j] = j < valid ? (lr * (targets[first + j] - line[j])) / gen_factor : 0;
+
+        // Both windows get the full correction, as in ContinousCMAC::updateCells
+        for (int w = 0; w < windows.count; w++)
+        {
+            float* row = weights + windows.start[w] * stride + first;
+            for (int c = 0; c < gen_factor; c++, row += stride)
+            {
+#ifdef CMAC_MODEL_BANK_SSE2
+                for (size_t j = 0; j < line_floats; j += 4)
+                    _mm_store_ps(row + j, _mm_add_ps(_mm_load_ps(row + j), _mm_load_ps(line + j)));
+#else
+                for (size_t j = 0; j < line_floats; j++)
+                    row[j] += line[j];
+#endif
+            }
+        }
+    }
+}
@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * CMAC with several outputs per input (e.g. the joint torques of an inverse dynamics model).
+ * Every input maps to one set of active cells, and the weight table stores the outputs of a
+ * cell next to each other: output k is model k of a ModelBank, so the outputs of one cell share
+ * a 64 byte row (up to 16 outputs) and predict and update handle all of them with SIMD.
+ */
+
+#include <cmath>
+#include <vector>
+#include "cmac.h"
+#include "model_bank.h"
+
+/**
+ * @brief Multi Output CMAC Class
+ * Trains num_outputs outputs of one variant and shape on a shared input.
+ */
+class MultiOutputCMAC
+{
+private:
+    ModelBank bank;
+    int num_outputs;
+    int epochs_trained;
+    float curr_loss;
+
+public:
+    MultiOutputCMAC(const std::string& variant, int num_outputs, int gen_factor, int num_weights, float lowerlimit, float upperlimit);
+    int getNumOutputs() const;
+    const ModelBank& getBank() const;
+    int getEpochsTrained() const;
+    float getLoss() const;
+    void predict(float x, float* out) const;
+    void learn(float x, const float* targets, float lr);
+    float calculateError(const std::vector<float>& inputs, const std::vector<float>& targets) const;
+    bool train(const std::vector<float>& inputs, const std::vector<float>& targets, int epochs, float lr, float convergenceThreshold);
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the MultiOutputCMAC class with every weight at 1
+ *
+ * @param variant "discrete" or "continous"
+ * @param num_outputs Number of outputs per input
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param num_weights Number of cells (each holds num_outputs weights)
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+MultiOutputCMAC::MultiOutputCMAC(const std::string& variant, int num_outputs, int gen_factor, int num_weights, float lowerlimit, float upperlimit) :
+    bank(variant, num_outputs, gen_factor, num_weights, lowerlimit, upperlimit), num_outputs(num_outputs), epochs_trained(0), curr_loss(0) {};
+
+/**
+ * @brief Getter to get the number of outputs
+ * @return Number of outputs
+ */
+int MultiOutputCMAC::getNumOutputs() const
+{
+    return num_outputs;
+}
+
+/**
+ * @brief Getter to get the weight table, output k is model k of the bank
+ * @return Weight table
+ */
+const ModelBank& MultiOutputCMAC::getBank() const
+{
+    return bank;
+}
+
+/**
+ * @brief Getter to get the number of epochs trained by the last train call
+ * @return Epochs trained
+ */
+int MultiOutputCMAC::getEpochsTrained() const
+{
+    return epochs_trained;
+}
+
+/**
+ * @brief Getter to get the training loss after the last epoch
+ * @return Root mean squared error over every output
+ */
+float MultiOutputCMAC::getLoss() const
+{
+    return curr_loss;
+}
+
+/**
+ * @brief Predict every output for one input
+ *
+ * @param x Input value
+ * @param out Receives num_outputs output values
+ */
+void MultiOutputCMAC::predict(float x, float* out) const
+{
+    bank.predictAll(x, out);
+}
+
+/**
+ * @brief Online update of every output for one sample
+ *
+ * @param x Input value
+ * @param targets num_outputs target values
+ * @param lr Learning Rate for training
+ */
+void MultiOutputCMAC::learn(float x, const float* targets, float lr)
+{
+    bank.learnAll(x, targets, lr);
+}
+
+/**
+ * @brief Root mean squared error over every output of every sample
+ *
+ * @param inputs Input values
+ * @param targets Target values, num_outputs per input
+ * @return Root mean squared error
+ */
+float MultiOutputCMAC::calculateError(const std::vector<float>& inputs, const std::vector<float>& targets) const
+{
+    std::vector<float> out(num_outputs);
+    double sum = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        predict(inputs[i], out.data());
+        for (int k = 0; k < num_outputs; k++)
+        {
+            double error = targets[i * num_outputs + k] - out[k];
+            sum += error * error;
+        }
+    }
+    return inputs.empty() ? 0 : (float)sqrt(sum / (inputs.size() * num_outputs));
+}
+
+/**
+ * @brief Train every output in the order of the data until the loss changes less than the threshold
+ *
+ * @param inputs Input values
+ * @param targets Target values, num_outputs per input
+ * @param epochs Maximum number of passes over the data
+ * @param lr Learning Rate for training
+ * @param convergenceThreshold Smallest change of the loss between epochs that continues training
+ * @return True if training converged
+ */
+bool MultiOutputCMAC::train(const std::vector<float>& inputs, const std::vector<float>& targets, int epochs, float lr, float convergenceThreshold)
+{
+    float prev_loss = 0;
+    for (epochs_trained = 0; epochs_trained < epochs;)
+    {
+        for (size_t i = 0; i < inputs.size(); i++)
+            learn(inputs[i], targets.data() + i * num_outputs, lr);
+        epochs_trained++;
+
+        curr_loss = calculateError(inputs, targets);
+        if (epochs_trained > 1 && std::abs(prev_loss - curr_loss) < convergenceThreshold)
+            return true;
+        prev_loss = curr_loss;
+    }
+    return false;
+}
@@ -0,0 +1,661 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Reduced precision weight tables.
+ * Weights are stored as fp16, bf16 or int16 fixed point (one scale per table) and widened to
+ * fp32 for every sum and update, halving the bytes a prediction streams from memory.
+ * Updates are rounded stochastically by default: a weight moves to the next representable
+ * value with a probability proportional to the remainder, so corrections smaller than one
+ * step still add up in expectation instead of being rounded away.
+ */
+
+#include <cmath>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "cmac.h"
+#include "shuffle.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CMAC_PACKED_SSE2 1
+#endif
+
+/**
+ * @brief Element type of a weight table
+ */
+enum WeightStorage
+{
+    STORAGE_FP32 = 0,           // 4 bytes, the layout of CMAC::wt_vector
+    STORAGE_FP16,               // IEEE half, 10 bit mantissa, |w| < 65504
+    STORAGE_BF16,               // Upper half of an fp32, 7 bit mantissa, full fp32 range
+    STORAGE_INT16               // Fixed point, |w| <= range with 2^-15 * range resolution
+};
+
+/**
+ * @brief How an updated weight is rounded to the storage type
+ */
+enum RoundingMode
+{
+    ROUND_NEAREST = 0,
+    ROUND_STOCHASTIC
+};
+
+// 2^-112 and 2^112, the shift between the float and half exponent biases (decimal, hex float literals need C++17)
+constexpr float half_rebias_down = 1.92592994438723585305597794258492732e-34f;
+constexpr float half_rebias_up = 5192296858534827628530496329220096.0f;
+
+uint16_t floatToHalf(float value, uint32_t round_bits);
+float halfToFloat(uint16_t half);
+uint16_t floatToBF16(float value, uint32_t round_bits);
+float bf16ToFloat(uint16_t bf16);
+const char* weightStorageName(WeightStorage storage);
+
+/**
+ * @brief Packed Weights Class
+ * A weight table in one of the WeightStorage types with fp32 sums and rounded updates.
+ */
+class PackedWeights
+{
+private:
+    WeightStorage storage;
+    RoundingMode rounding;
+    float scale;                        // int16: weight value of one step
+    std::vector<float> fp32;
+    std::vector<uint16_t> packed;
+    uint64_t random_state;
+    uint64_t random_bits;
+    int random_left;
+
+    uint32_t nextRandom16();
+    uint16_t pack(float value, uint32_t random16) const;
+    float unpack(uint16_t value) const;
+#ifdef CMAC_PACKED_SSE2
+    __m128i nextRandom8x16();
+    template <WeightStorage packed_type> static __m128 widen4(__m128i value, __m128 step);
+    template <WeightStorage packed_type> static __m128i narrow4(__m128 value, __m128i random16, __m128 step);
+    template <WeightStorage packed_type> float sumPacked(size_t first, size_t end) const;
+    template <WeightStorage packed_type> void addPacked(size_t first, size_t end, float delta);
+#endif
+
+public:
+    PackedWeights(WeightStorage storage, size_t count, float initial, float range, RoundingMode rounding, uint64_t seed);
+    WeightStorage getStorage() const;
+    RoundingMode getRounding() const;
+    size_t size() const;
+    size_t getBytes() const;
+    float get(size_t i) const;
+    void set(size_t i, float value);
+    float sum(size_t first, size_t n) const;
+    void add(size_t first, size_t n, float delta);
+};
+
+/**
+ * @brief Packed Model Class
+ * A CMAC of either variant whose weights live in a PackedWeights table.
+ */
+class PackedModel
+{
+private:
+    std::unique_ptr<CMAC> shape;
+    PackedWeights weights;
+    int gen_factor;
+    float lowerlimit;
+    float upperlimit;
+
+public:
+    PackedModel(const std::string& variant, int gen_factor, int num_weights, float lowerlimit, float upperlimit, WeightStorage storage,
+                float range, RoundingMode rounding, uint64_t seed);
+    const PackedWeights& getWeights() const;
+    void importModel(const CMAC& source);
+    float predict(float x) const;
+    void learn(std::pair<float, float> data_element, float lr);
+    float calculateError(const std::vector<std::pair<float, float>>& data) const;
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Convert to IEEE half precision, saturating at the largest finite half
+ * Multiplying by 2^-112 moves the float exponent to the half bias, so the half is the float's
+ * bits shifted down by 13 (half subnormals become float subnormals with the same mantissa).
+ *
+ * @param value Value to convert
+ * @param round_bits Added to the 13 dropped mantissa bits before truncation (0x1000 rounds to nearest, uniform random bits round stochastically)
+ * @return Half precision bits
+ */
+uint16_t floatToHalf(float value, uint32_t round_bits)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude > 0x7f800000)
+        return sign | 0x7e00;
+
+    float rebiased;
+    memcpy(&rebiased, &magnitude, sizeof(rebiased));
+    rebiased *= half_rebias_down;
+    memcpy(&magnitude, &rebiased, sizeof(magnitude));
+    return sign | std::min<uint32_t>((magnitude + round_bits) >> 13, 0x7bff);
+}
+
+/**
+ * @brief Convert IEEE half precision to float (exact, the inverse rebias of floatToHalf)
+ * @param half Half precision bits
+ * @return Value
+ */
+float halfToFloat(uint16_t half)
+{
+    uint32_t bits = (uint32_t)(half & 0x7fff) << 13;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    value *= half_rebias_up;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((half & 0x7c00) == 0x7c00)
+        bits |= 0x7f800000;
+    bits |= (uint32_t)(half & 0x8000) << 16;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Convert to bfloat16, saturating at the largest finite bfloat16
+ *
+ * @param value Value to convert
+ * @param round_bits Added to the 16 dropped mantissa bits before truncation (0x8000 rounds to nearest, uniform random bits round stochastically)
+ * @return bfloat16 bits
+ */
+uint16_t floatToBF16(float value, uint32_t round_bits)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000)
+        return (uint16_t)((bits >> 16) | 0x40);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = ((bits & 0x7fffffff) + round_bits) >> 16;
+    return sign | std::min<uint32_t>(magnitude, 0x7f7f);
+}
+
+/**
+ * @brief Convert bfloat16 to float
+ * @param bf16 bfloat16 bits
+ * @return Value
+ */
+float bf16ToFloat(uint16_t bf16)
+{
+    uint32_t bits = (uint32_t)bf16 << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Name of a storage type for reports
+ * @param storage Storage type
+ * @return Name
+ */
+const char* weightStorageName(WeightStorage storage)
+{
+    switch (storage)
+    {
+    case STORAGE_FP16:
+        return "fp16";
+    case STORAGE_BF16:
+        return "bf16";
+    case STORAGE_INT16:
+        return "int16";
+    default:
+        return "fp32";
+    }
+}
+
+/**
+ * @brief Initialize the PackedWeights class with every weight at the same value
+ *
+ * @param storage Element type
+ * @param count Number of weights
+ * @param initial Initial weight value
+ * @param range Largest weight magnitude int16 storage can hold (ignored by the other types)
+ * @param rounding Rounding of updated weights
+ * @param seed Seed of the stochastic rounding stream
+ */
+PackedWeights::PackedWeights(WeightStorage storage, size_t count, float initial = 1, float range = 16, RoundingMode rounding = ROUND_STOCHASTIC, uint64_t seed = 0) :
+    storage(storage), rounding(rounding), scale(range / 32767), random_state(seed), random_bits(0), random_left(0)
+{
+    if (storage == STORAGE_FP32)
+        fp32.assign(count, initial);
+    else
+        packed.assign(count, pack(initial, 0x8000));
+}
+
+/**
+ * @brief Next 16 uniform random bits, four per SplitMix64 draw
+ * @return Random value in [0, 65536)
+ */
+uint32_t PackedWeights::nextRandom16()
+{
+    if (!random_left)
+    {
+        random_bits = splitmix64(random_state++);
+        random_left = 4;
+    }
+    uint32_t bits = random_bits & 0xffff;
+    random_bits >>= 16;
+    random_left--;
+    return bits;
+}
+
+/**
+ * @brief Round a value to the storage type
+ *
+ * @param value Value to store
+ * @param random16 Rounding offset in [0, 65536), 0x8000 rounds to nearest
+ * @return Stored bits
+ */
+uint16_t PackedWeights::pack(float value, uint32_t random16) const
+{
+    switch (storage)
+    {
+    case STORAGE_FP16:
+        return floatToHalf(value, random16 >> 3);
+    case STORAGE_BF16:
+        return floatToBF16(value, random16);
+    default:
+    {
+        // floor(steps + u) rounds up with probability equal to the fraction for uniform u in [0, 1)
+        float steps = std::max(-32767.0f, std::min(32767.0f, value / scale + random16 * (1.0f / 65536)));
+        return (uint16_t)(int16_t)floorf(steps);
+    }
+    }
+}
+
+/**
+ * @brief Widen stored bits to float
+ * @param value Stored bits
+ * @return Weight value
+ */
+float PackedWeights::unpack(uint16_t value) const
+{
+    switch (storage)
+    {
+    case STORAGE_FP16:
+        return halfToFloat(value);
+    case STORAGE_BF16:
+        return bf16ToFloat(value);
+    default:
+        return (int16_t)value * scale;
+    }
+}
+
+#ifdef CMAC_PACKED_SSE2
+
+/**
+ * @brief Eight 16 bit rounding offsets, uniform for stochastic rounding and 0x8000 for nearest
+ * @return Offsets
+ */
+__m128i PackedWeights::nextRandom8x16()
+{
+    if (rounding != ROUND_STOCHASTIC)
+        return _mm_set1_epi16((short)0x8000);
+    uint64_t lo = splitmix64(random_state++);
+    uint64_t hi = splitmix64(random_state++);
+    return _mm_set_epi64x((long long)hi, (long long)lo);
+}
+
+/**
+ * @brief Widen four stored values to floats, matching unpack
+ *
+ * @param value Four stored values in the upper halves of 32 bit lanes
+ * @param step int16: weight value of one step
+ * @return Values
+ */
+template <WeightStorage packed_type>
+__m128 PackedWeights::widen4(__m128i value, __m128 step)
+{
+    if (packed_type == STORAGE_BF16)
+        return _mm_castsi128_ps(value);
+    if (packed_type == STORAGE_INT16)
+        return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(value, 16)), step);
+
+    // Same rebias as halfToFloat, with the half in bits 31..16 moved down to 28..13
+    const __m128i exponent_mask = _mm_set1_epi32(0x7c000000);
+    __m128 magnitude = _mm_mul_ps(_mm_castsi128_ps(_mm_srli_epi32(_mm_and_si128(value, _mm_set1_epi32(0x7fff0000)), 3)), _mm_set1_ps(half_rebias_up));
+    __m128i special = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(value, exponent_mask), exponent_mask), _mm_set1_epi32(0x7f800000));
+    __m128i sign = _mm_and_si128(value, _mm_set1_epi32((int)0x80000000));
+    return _mm_or_ps(magnitude, _mm_castsi128_ps(_mm_or_si128(special, sign)));
+}
+
+/**
+ * @brief Round four floats to the storage type, matching pack
+ *
+ * @param value Values
+ * @param random16 Rounding offsets in [0, 65536)
+ * @param step int16: weight value of one step
+ * @return Stored values sign extended to 32 bit lanes (ready for _mm_packs_epi32)
+ */
+template <WeightStorage packed_type>
+__m128i PackedWeights::narrow4(__m128 value, __m128i random16, __m128 step)
+{
+    if (packed_type == STORAGE_INT16)
+    {
+        __m128 steps = _mm_add_ps(_mm_div_ps(value, step), _mm_mul_ps(_mm_cvtepi32_ps(random16), _mm_set1_ps(1.0f / 65536)));
+        steps = _mm_max_ps(_mm_set1_ps(-32767.0f), _mm_min_ps(_mm_set1_ps(32767.0f), steps));
+        // floor: truncate, then step down where truncation rounded a negative value up
+        __m128i truncated = _mm_cvttps_epi32(steps);
+        return _mm_add_epi32(truncated, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), steps)));
+    }
+
+    __m128i bits = _mm_castps_si128(value);
+    __m128i sign = _mm_and_si128(bits, _mm_set1_epi32((int)0x80000000));
+    __m128i magnitude = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+    __m128i largest;
+    if (packed_type == STORAGE_BF16)
+    {
+        magnitude = _mm_srli_epi32(_mm_add_epi32(magnitude, random16), 16);
+        largest = _mm_set1_epi32(0x7f7f);
+    }
+    else
+    {
+        magnitude = _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_set1_ps(half_rebias_down)));
+        magnitude = _mm_srli_epi32(_mm_add_epi32(magnitude, _mm_srli_epi32(random16, 3)), 13);
+        largest = _mm_set1_epi32(0x7bff);
+    }
+    __m128i over = _mm_cmpgt_epi32(magnitude, largest);
+    magnitude = _mm_or_si128(_mm_andnot_si128(over, magnitude), _mm_and_si128(over, largest));
+    // Sign and value in the upper half, so srai and packs move them down unchanged
+    return _mm_srai_epi32(_mm_or_si128(_mm_slli_epi32(magnitude, 16), sign), 16);
+}
+
+/**
+ * @brief Sum of whole groups of eight packed weights
+ *
+ * @param first First weight index
+ * @param end One past the last weight index (end - first is a multiple of 8)
+ * @return Sum
+ */
+template <WeightStorage packed_type>
+float PackedWeights::sumPacked(size_t first, size_t end) const
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 step = _mm_set1_ps(scale);
+    __m128 acc = _mm_setzero_ps();
+    for (size_t i = first; i < end; i += 8)
+    {
+        __m128i value = _mm_loadu_si128((const __m128i*)&packed[i]);
+        acc = _mm_add_ps(acc, _mm_add_ps(widen4<packed_type>(_mm_unpacklo_epi16(zero, value), step), widen4<packed_type>(_mm_unpackhi_epi16(zero, value), step)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+/**
+ * @brief Add a correction to whole groups of eight packed weights
+ *
+ * @param first First weight index
+ * @param end One past the last weight index (end - first is a multiple of 8)
+ * @param delta Correction
+ */
+template <WeightStorage packed_type>
+void PackedWeights::addPacked(size_t first, size_t end, float delta)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 step = _mm_set1_ps(scale);
+    const __m128 correction = _mm_set1_ps(delta);
+    for (size_t i = first; i < end; i += 8)
+    {
+        __m128i value = _mm_loadu_si128((const __m128i*)&packed[i]);
+        __m128i random16 = nextRandom8x16();
+        __m128 lo = _mm_add_ps(widen4<packed_type>(_mm_unpacklo_epi16(zero, value), step), correction);
+        __m128 hi = _mm_add_ps(widen4<packed_type>(_mm_unpackhi_epi16(zero, value), step), correction);
+        __m128i stored = _mm_packs_epi32(narrow4<packed_type>(lo, _mm_unpacklo_epi16(random16, zero), step),
+                                         narrow4<packed_type>(hi, _mm_unpackhi_epi16(random16, zero), step));
+        _mm_storeu_si128((__m128i*)&packed[i], stored);
+    }
+}
+
+#endif
+
+/**
+ * @brief Getter to get the storage type
+ * @return Storage type
+ */
+WeightStorage PackedWeights::getStorage() const
+{
+    return storage;
+}
+
+/**
+ * @brief Getter to get the rounding of updated weights
+ * @return Rounding mode
+ */
+RoundingMode PackedWeights::getRounding() const
+{
+    return rounding;
+}
+
+/**
+ * @brief Getter to get the number of weights
+ * @return Number of weights
+ */
+size_t PackedWeights::size() const
+{
+    return storage == STORAGE_FP32 ? fp32.size() : packed.size();
+}
+
+/**
+ * @brief Getter to get the bytes held by the weights
+ * @return Bytes
+ */
+size_t PackedWeights::getBytes() const
+{
+    return fp32.size() * sizeof(float) + packed.size() * sizeof(uint16_t);
+}
+
+/**
+ * @brief Read one weight
+ * @param i Weight index
+ * @return Weight value
+ */
+float PackedWeights::get(size_t i) const
+{
+    return storage == STORAGE_FP32 ? fp32[i] : unpack(packed[i]);
+}
+
+/**
+ * @brief Overwrite one weight, rounded to nearest
+ *
+ * @param i Weight index
+ * @param value Weight value
+ */
+void PackedWeights::set(size_t i, float value)
+{
+    if (storage == STORAGE_FP32)
+        fp32[i] = value;
+    else
+        packed[i] = pack(value, 0x8000);
+}
+
+/**
+ * @brief Sum of a window of weights, accumulated in fp32 (four lanes with SSE2)
+ *
+ * @param first First weight index
+ * @param n Number of weights
+ * @return Sum
+ */
+float PackedWeights::sum(size_t first, size_t n) const
+{
+    size_t i = first;
+    size_t end = first + n;
+    float res = 0;
+
+    if (storage == STORAGE_INT16)
+    {
+        // Integer sum of the steps, exact for any window below 65536 weights
+        int32_t steps = 0;
+#ifdef CMAC_PACKED_SSE2
+        __m128i acc = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        for (; i + 8 <= end; i += 8)
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)&packed[i]), ones));
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        steps = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+        for (; i < end; i++)
+            steps += (int16_t)packed[i];
+        return steps * scale;
+    }
+
+#ifdef CMAC_PACKED_SSE2
+    if (storage == STORAGE_FP32)
+    {
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4)
+            acc = _mm_add_ps(acc, _mm_loadu_ps(&fp32[i]));
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        res = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+    else
+    {
+        size_t whole = first + n / 8 * 8;
+        res = storage == STORAGE_BF16 ? sumPacked<STORAGE_BF16>(first, whole) : sumPacked<STORAGE_FP16>(first, whole);
+        i = whole;
+    }
+#endif
+
+    for (; i < end; i++)
+        res += get(i);
+    return res;
+}
+
+/**
+ * @brief Add the same correction to a window of weights, in fp32 and rounded back to the storage type
+ *
+ * @param first First weight index
+ * @param n Number of weights
+ * @param delta Correction
+ */
+void PackedWeights::add(size_t first, size_t n, float delta)
+{
+    size_t i = first;
+    size_t end = first + n;
+    if (storage == STORAGE_FP32)
+    {
+        for (; i < end; i++)
+            fp32[i] += delta;
+        return;
+    }
+
+#ifdef CMAC_PACKED_SSE2
+    size_t whole = first + n / 8 * 8;
+    if (storage == STORAGE_FP16)
+        addPacked<STORAGE_FP16>(first, whole, delta);
+    else if (storage == STORAGE_BF16)
+        addPacked<STORAGE_BF16>(first, whole, delta);
+    else
+        addPacked<STORAGE_INT16>(first, whole, delta);
+    i = whole;
+#endif
+    for (; i < end; i++)
+        packed[i] = pack(unpack(packed[i]) + delta, rounding == ROUND_STOCHASTIC ? nextRandom16() : 0x8000);
+}
+
+/**
+ * @brief Initialize the PackedModel class with every weight at 1, like a fresh CMAC
+ *
+ * @param variant "discrete" or "continous"
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param num_weights Number of weights
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @param storage Element type of the weights
+ * @param range Largest weight magnitude int16 storage can hold
+ * @param rounding Rounding of updated weights
+ * @param seed Seed of the stochastic rounding stream
+ */
+PackedModel::PackedModel(const std::string& variant, int gen_factor, int num_weights, float lowerlimit, float upperlimit, WeightStorage storage,
+                         float range = 16, RoundingMode rounding = ROUND_STOCHASTIC, uint64_t seed = 0) :
+    shape(createShapeCMAC(variant, gen_factor, num_weights)), weights(storage, num_weights, 1, range, rounding, seed), gen_factor(gen_factor),
+    lowerlimit(lowerlimit), upperlimit(upperlimit) {};
+
+/**
+ * @brief Getter to get the weight table
+ * @return Weight table
+ */
+const PackedWeights& PackedModel::getWeights() const
+{
+    return weights;
+}
+
+/**
+ * @brief Copy (and round) the weights of a trained CMAC of the same shape
+ * @param source CMAC of the model's variant and shape
+ */
+void PackedModel::importModel(const CMAC& source)
+{
+    source.forEachWeight([&](size_t i, float w) { weights.set(i, w); });
+}
+
+/**
+ * @brief Predict a single input value
+ * @param x Input value
+ * @return Predicted output value
+ */
+float PackedModel::predict(float x) const
+{
+    float res = 0;
+    shape->forEachActiveWindow(x, lowerlimit, upperlimit, [&](int start, float share) { res += weights.sum(start, gen_factor) * share; });
+    return res;
+}
+
+/**
+ * @brief Online update for one sample (uniform update, as CMAC::learnSample)
+ *
+ * @param data_element Pair of the input and output data value
+ * @param lr Learning Rate for training
+ */
+void PackedModel::learn(std::pair<float, float> data_element, float lr)
+{
+    float error = data_element.second - predict(data_element.first);
+    float correction = (lr * error) / gen_factor;
+    shape->forEachActiveWindow(data_element.first, lowerlimit, upperlimit, [&](int start, float) { weights.add(start, gen_factor, correction); });
+}
+
+/**
+ * @brief Root mean squared error over a dataset
+ * @param data Continer of the input and output data values
+ * @return Root mean squared error
+ */
+float PackedModel::calculateError(const std::vector<std::pair<float, float>>& data) const
+{
+    std::vector<std::pair<float, float>> predicted_data;
+    predicted_data.reserve(data.size());
+    for (auto& data_element : data)
+        predicted_data.push_back({ data_element.first, predict(data_element.first) });
+    return shape->calculateError(data, predicted_data);
+}
@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Optional hardware performance counters around the training phases.
+ * Build with -DCMAC_PERF_COUNTERS (Linux only, uses perf_event_open) to enable;
+ * otherwise CMAC_PERF_SCOPE expands to nothing and no counter code is compiled.
+ */
+
+#include <cstdint>
+
+/**
+ * @brief Training phases that are counted separately
+ */
+enum PerfPhase
+{
+    PERF_UPDATE = 0,        // Weight update pass over the training data
+    PERF_EVALUATE,          // Evaluation (predict) pass of every epoch
+    PERF_ASSOCIATION,       // generateAssociationMap
+    PERF_PHASE_COUNT
+};
+
+/**
+ * @brief Counter values for one phase
+ */
+struct PerfCounts
+{
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t l1d_misses;
+    uint64_t llc_misses;
+    uint64_t branch_misses;
+    uint64_t dtlb_misses;
+    uint64_t uncounted_scopes;  // Scopes the kernel never scheduled the group for, their counts are missing
+};
+
+#if defined(CMAC_PERF_COUNTERS) && defined(__linux__)
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/**
+ * @brief Per thread Performance Counter Group Class
+ * Opens one perf_event group (cycles, instructions, L1D read misses, LLC misses,
+ * branch misses, dTLB read misses) for the calling thread and accumulates deltas per phase.
+ */
+class PerfCounters
+{
+public:
+    static constexpr int counter_count = 6;
+    static constexpr int reading_size = counter_count + 2;      // Counters, then time enabled and time running
+
+private:
+    int fds[counter_count];
+    bool enabled;
+    PerfCounts totals[PERF_PHASE_COUNT];
+
+    int openCounter(uint32_t type, uint64_t config, int group_fd);
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+    bool read(uint64_t values[]);
+    void accumulate(PerfPhase phase, const uint64_t start[], const uint64_t end[]);
+    void collect(PerfCounts phases[]);
+    static PerfCounters& local();
+};
+
+/**
+ * @brief RAII scope adding the counter delta of its lifetime to a phase
+ */
+class PerfScope
+{
+private:
+    PerfPhase phase;
+    uint64_t start[PerfCounters::reading_size];
+    bool valid;
+
+public:
+    PerfScope(PerfPhase phase);
+    ~PerfScope();
+};
+
+#define CMAC_PERF_CONCAT_(a, b) a##b
+#define CMAC_PERF_CONCAT(a, b) CMAC_PERF_CONCAT_(a, b)
+#define CMAC_PERF_SCOPE(phase) PerfScope CMAC_PERF_CONCAT(perf_scope_, __LINE__)(phase)
+#define CMAC_PERF_ENABLED 1
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Open the counter group for the calling thread
+ */
+PerfCounters::PerfCounters() : enabled(false)
+{
+    memset(totals, 0, sizeof(totals));
+    uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    fds[0] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    fds[1] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fds[0]);
+    fds[2] = openCounter(PERF_TYPE_HW_CACHE, l1d_read_miss, fds[0]);
+    fds[3] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, fds[0]);
+    fds[4] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, fds[0]);
+    fds[5] = openCounter(PERF_TYPE_HW_CACHE, dtlb_read_miss, fds[0]);
+
+    enabled = true;
+    for (int i = 0; i < counter_count; i++)
+        enabled = enabled && fds[i] >= 0;
+
+    if (!enabled)
+    {
+        std::cerr << "perf_event_open failed (" << strerror(errno) << "), hardware counters disabled" << std::endl;
+        return;
+    }
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/**
+ * @brief Close the counter group
+ */
+PerfCounters::~PerfCounters()
+{
+    for (int i = 0; i < counter_count; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+}
+
+/**
+ * @brief Open one counter of the group for the calling thread on any CPU
+ *
+ * @param type perf event type
+ * @param config perf event config
+ * @param group_fd Group leader (-1 for the leader itself)
+ * @return File descriptor or -1
+ */
+int PerfCounters::openCounter(uint32_t type, uint64_t config, int group_fd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/**
+ * @brief Read every counter of the group with a single syscall
+ *
+ * @param values Receives reading_size values: the counters, then the time the group was enabled and running
+ * @return False if the counters are unavailable
+ */
+bool PerfCounters::read(uint64_t values[])
+{
+    if (!enabled)
+        return false;
+    // Group read layout: nr, time_enabled, time_running, values[nr]
+    uint64_t buffer[3 + counter_count];
+    if (::read(fds[0], buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer))
+        return false;
+    for (int i = 0; i < counter_count; i++)
+        values[i] = buffer[3 + i];
+    values[counter_count] = buffer[1];
+    values[counter_count + 1] = buffer[2];
+    return true;
+}
+
+/**
+ * @brief Add the difference of two readings to a phase
+ * When the kernel multiplexed the group, the deltas are scaled by time enabled / time running;
+ * if the group never ran, the scope is only counted in uncounted_scopes.
+ *
+ * @param phase Phase to charge
+ * @param start Reading at the start of the phase
+ * @param end Reading at the end of the phase
+ */
+void PerfCounters::accumulate(PerfPhase phase, const uint64_t start[], const uint64_t end[])
+{
+    PerfCounts& t = totals[phase];
+    uint64_t enabled_ns = end[counter_count] - start[counter_count];
+    uint64_t running_ns = end[counter_count + 1] - start[counter_count + 1];
+    if (running_ns == 0)
+    {
+        t.uncounted_scopes++;
+        return;
+    }
+
+    double scale = (double)enabled_ns / running_ns;
+    uint64_t delta[counter_count];
+    for (int i = 0; i < counter_count; i++)
+        delta[i] = (uint64_t)((end[i] - start[i]) * scale + 0.5);
+    t.cycles += delta[0];
+    t.instructions += delta[1];
+    t.l1d_misses += delta[2];
+    t.llc_misses += delta[3];
+    t.branch_misses += delta[4];
+    t.dtlb_misses += delta[5];
+}
+
+/**
+ * @brief Copy out the per phase totals and start counting from zero again
+ * @param phases Receives PERF_PHASE_COUNT entries
+ */
+void PerfCounters::collect(PerfCounts phases[])
+{
+    memcpy(phases, totals, sizeof(totals));
+    memset(totals, 0, sizeof(totals));
+}
+
+/**
+ * @brief Counter group of the calling thread (opened on first use)
+ * @return Thread local counters
+ */
+PerfCounters& PerfCounters::local()
+{
+    thread_local PerfCounters counters;
+    return counters;
+}
+
+/**
+ * @brief Initialize the PerfScope class and take the starting reading
+ * @param phase Phase to charge
+ */
+PerfScope::PerfScope(PerfPhase phase) : phase(phase)
+{
+    valid = PerfCounters::local().read(start);
+}
+
+/**
+ * @brief Take the closing reading and charge the phase
+ */
+PerfScope::~PerfScope()
+{
+    uint64_t end[PerfCounters::reading_size];
+    if (valid && PerfCounters::local().read(end))
+        PerfCounters::local().accumulate(phase, start, end);
+}
+
+#else
+
+#define CMAC_PERF_SCOPE(phase) ((void)0)
+#define CMAC_PERF_ENABLED 0
+
+#endif
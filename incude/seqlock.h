@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Seqlock protected weight table for one online-learning writer and real-time readers.
+ * The writer never waits; a reader copies the weights it needs and retries if a write
+ * overlapped the copy. Cheaper than snapshots for small tables updated every sample.
+ */
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include "cmac.h"
+
+/**
+ * @brief Seqlock Weights Class
+ * The sequence is odd while a write is in progress. Weights are relaxed atomics so that
+ * concurrent copies are well defined; on common targets these are plain loads and stores.
+ */
+class SeqlockWeights
+{
+private:
+    alignas(64) std::atomic<uint64_t> sequence;
+    size_t count;
+    std::unique_ptr<std::atomic<float>[]> weights;
+
+public:
+    SeqlockWeights(Span<float> initial);
+    size_t size() const;
+    void write(int first, const float* values, int n);
+    uint64_t read(int first, float* out, int n) const;
+    uint64_t getSequence() const;
+};
+
+/**
+ * @brief Seqlock Model Class
+ * Wraps a model that a single writer thread trains online, sample by sample, and
+ * publishes every changed window of weights through the seqlock to reader threads.
+ */
+class SeqlockModel
+{
+private:
+    CMAC& model;
+    float lowerlimit;
+    float upperlimit;
+    SeqlockWeights table;
+
+public:
+    SeqlockModel(CMAC& model, float lowerlimit, float upperlimit);
+    void learn(std::pair<float, float> data_element, float lr);
+    float predict(float x, uint64_t* retries) const;
+    const SeqlockWeights& getTable() const;
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the SeqlockWeights class with a copy of the weights
+ * @param initial Initial weights
+ */
+SeqlockWeights::SeqlockWeights(Span<float> initial) : sequence(0), count(initial.size()), weights(new std::atomic<float>[initial.size()])
+{
+    for (size_t i = 0; i < count; i++)
+        weights[i].store(initial[i], std::memory_order_relaxed);
+}
+
+/**
+ * @brief Getter to get the number of weights
+ * @return Table size
+ */
+size_t SeqlockWeights::size() const
+{
+    return count;
+}
+
+/**
+ * @brief Overwrite a range of weights (single writer thread only)
+ *
+ * @param first First weight index
+ * @param values New values
+ * @param n Number of weights
+ */
+void SeqlockWeights::write(int first, const float* values, int n)
+{
+    uint64_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    // Orders the odd sequence before the weight stores
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < n; i++)
+        weights[first + i].store(values[i], std::memory_order_relaxed);
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Copy a consistent range of weights, retrying while writes overlap the copy
+ *
+ * @param first First weight index
+ * @param out Receives n weights
+ * @param n Number of weights
+ * @return Number of retries
+ */
+uint64_t SeqlockWeights::read(int first, float* out, int n) const
+{
+    uint64_t retries = 0;
+    while (true)
+    {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if (!(before & 1))
+        {
+            for (int i = 0; i < n; i++)
+                out[i] = weights[first + i].load(std::memory_order_relaxed);
+            // Orders the weight loads before the second sequence load
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+                return retries;
+        }
+        retries++;
+    }
+}
+
+/**
+ * @brief Getter to get the sequence number (twice the number of completed writes)
+ * @return Sequence
+ */
+uint64_t SeqlockWeights::getSequence() const
+{
+    return sequence.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Initialize the SeqlockModel class from the current weights of a model
+ * The model must not be used by other threads afterwards except through this wrapper.
+ *
+ * @param model Model trained online by the writer thread
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+SeqlockModel::SeqlockModel(CMAC& model, float lowerlimit, float upperlimit) : model(model), lowerlimit(lowerlimit), upperlimit(upperlimit), table(model.getWtVector()) {};
+
+/**
+ * @brief Learn one sample and publish the changed weights (writer thread only)
+ *
+ * @param data_element Pair of the input and output data value
+ * @param lr Learning Rate for training
+ */
+void SeqlockModel::learn(std::pair<float, float> data_element, float lr)
+{
+    int start_index = model.learnSample(data_element, lowerlimit, upperlimit, lr);
+    // Covers the single window of the discrete and both windows of the continous variant
+    int n = std::min(model.getGenFactor() + 1, (int)table.size() - start_index);
+    table.write(start_index, model.getWtVector().data() + start_index, n);
+}
+
+/**
+ * @brief Predict a single input value from a consistent copy of its active weights (any thread)
+ *
+ * @param x Input value
+ * @param retries Receives the number of torn reads that were retried (may be nullptr)
+ * @return Predicted output value
+ */
+float SeqlockModel::predict(float x, uint64_t* retries = nullptr) const
+{
+    // Scratch table of the full shape, only the active window is filled in
+    thread_local std::vector<float> scratch;
+    if (scratch.size() < table.size())
+        scratch.resize(table.size());
+
+    int start_index = model.getAssociationIndex(x, lowerlimit, upperlimit);
+    int n = std::min(model.getGenFactor() + 1, (int)table.size() - start_index);
+    uint64_t r = table.read(start_index, scratch.data() + start_index, n);
+    if (retries)
+        *retries += r;
+    return model.predictWith(scratch.data(), x, lowerlimit, upperlimit);
+}
+
+/**
+ * @brief Getter to get the seqlock protected table
+ * @return Weight table
+ */
+const SeqlockWeights& SeqlockModel::getTable() const
+{
+    return table;
+}
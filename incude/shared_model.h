@@ -0,0 +1,347 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Model weights in a POSIX shared-memory segment.
+ * One trainer process creates the segment and publishes weights into it; any number of reader
+ * processes map the same pages read-only, so a host holds one copy of each table.
+ * A generation counter in the header is odd while a publish is in progress, readers retry
+ * predictions that overlapped one.
+ */
+
+#include <atomic>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <thread>
+#include <algorithm>
+#include "cmac.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define CMAC_SHARED_MEMORY 1
+#endif
+
+/**
+ * @brief Header at the start of the segment, the weights follow at the next cache line
+ */
+struct alignas(64) SharedModelHeader
+{
+    char magic[4];                      // "CMSH"
+    uint32_t version;
+    char variant[16];                   // getName() of the model
+    int32_t gen_factor;
+    int32_t num_weights;
+    float lowerlimit;
+    float upperlimit;
+    std::atomic<uint64_t> generation;   // Odd while the trainer is writing
+};
+
+// Processes map the header at different addresses, so the counter must not rely on a per process lock
+// (ATOMIC_LLONG_LOCK_FREE is the C++14 spelling of std::atomic<uint64_t>::is_always_lock_free)
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(long long) == sizeof(uint64_t), "the shared generation counter needs lock free 64 bit atomics");
+
+/**
+ * @brief Shared Model Class
+ * Mapping of one shared model segment, writable by the creating trainer and read-only for readers.
+ */
+class SharedModel
+{
+private:
+    std::string name;
+    SharedModelHeader* header;
+    float* weights;
+    size_t mapped_size;
+    bool writable;
+    std::unique_ptr<CMAC> shape;
+
+    // Reads give up after this many overlapping publishes, e.g. when a trainer died mid-publish
+    static const int max_read_retries = 1 << 20;
+
+    SharedModel(const std::string& name, void* mapping, size_t mapped_size, bool writable);
+    static size_t segmentSize(int num_weights);
+
+public:
+    ~SharedModel();
+    static std::unique_ptr<SharedModel> create(const std::string& name, const CMAC& model, float lowerlimit, float upperlimit);
+    static std::unique_ptr<SharedModel> open(const std::string& name);
+    static bool remove(const std::string& name);
+    void publish(const CMAC& model);
+    void publishRange(const CMAC& model, int first, int n);
+    bool predict(float x, float& out, uint64_t* retries) const;
+    uint64_t getGeneration() const;
+    int getNumWeights() const;
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Bytes of a segment holding a header and num_weights weights
+ * @param num_weights Number of weights
+ * @return Segment size
+ */
+size_t SharedModel::segmentSize(int num_weights)
+{
+    return sizeof(SharedModelHeader) + (size_t)num_weights * sizeof(float);
+}
+
+/**
+ * @brief Initialize the SharedModel class over an existing mapping
+ *
+ * @param name Segment name
+ * @param mapping Start of the mapped segment
+ * @param mapped_size Mapped bytes
+ * @param writable True for the trainer mapping
+ */
+SharedModel::SharedModel(const std::string& name, void* mapping, size_t mapped_size, bool writable) : name(name),
+    header((SharedModelHeader*)mapping), weights((float*)((char*)mapping + sizeof(SharedModelHeader))), mapped_size(mapped_size), writable(writable)
+{
+    std::string variant(header->variant, strnlen(header->variant, sizeof(header->variant)));
+    shape = createShapeCMAC(variant == "DiscreteCMAC" ? "discrete" : "continous", header->gen_factor, header->num_weights);
+}
+
+#ifdef CMAC_SHARED_MEMORY
+
+/**
+ * @brief Unmap the segment (the segment itself stays until remove is called)
+ */
+SharedModel::~SharedModel()
+{
+    munmap(header, mapped_size);
+}
+
+/**
+ * @brief Create (or replace) a segment sized for a model and publish its current weights
+ * An existing segment of the same name is unlinked first and a fresh one is created, so readers
+ * that still map the old segment keep a consistent (stale) model instead of seeing it resized.
+ *
+ * @param name Segment name, e.g. "/cmac_joint0"
+ * @param model Model whose variant, shape and weights are stored
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Writable mapping (nullptr on failure)
+ */
+std::unique_ptr<SharedModel> SharedModel::create(const std::string& name, const CMAC& model, float lowerlimit, float upperlimit)
+{
+    int num_weights = (int)model.getWtVector().size();
+    size_t size = segmentSize(num_weights);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0)
+    {
+        std::cerr << "shm_open " << name << " failed (" << strerror(errno) << ")" << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "mmap " << name << " failed (" << strerror(errno) << ")" << std::endl;
+        return nullptr;
+    }
+
+    SharedModelHeader* header = new (mapping) SharedModelHeader();
+    memcpy(header->magic, "CMSH", 4);
+    header->version = 1;
+    memset(header->variant, 0, sizeof(header->variant));
+    strncpy(header->variant, model.getName(), sizeof(header->variant) - 1);
+    header->gen_factor = model.getGenFactor();
+    header->num_weights = num_weights;
+    header->lowerlimit = lowerlimit;
+    header->upperlimit = upperlimit;
+    header->generation.store(0);
+
+    std::unique_ptr<SharedModel> shared(new SharedModel(name, mapping, size, true));
+    shared->publish(model);
+    return shared;
+}
+
+/**
+ * @brief Map an existing segment read-only
+ *
+ * @param name Segment name
+ * @return Read-only mapping (nullptr if the segment is missing or not a model segment)
+ */
+std::unique_ptr<SharedModel> SharedModel::open(const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SharedModelHeader))
+    {
+        std::cerr << "shm_open " << name << " failed (" << (fd < 0 ? strerror(errno) : "not a model segment") << ")" << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return nullptr;
+    }
+    size_t size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+
+    // The header comes from another process: check it before it sizes or shapes anything here
+    SharedModelHeader* header = (SharedModelHeader*)mapping;
+    size_t variant_length = strnlen(header->variant, sizeof(header->variant));
+    std::string variant(header->variant, variant_length);
+    if (memcmp(header->magic, "CMSH", 4) || header->version != 1 || variant_length == sizeof(header->variant)
+        || (variant != "DiscreteCMAC" && variant != "ContinousCMAC") || header->gen_factor < 1
+        || header->num_weights < header->gen_factor + 2 || segmentSize(header->num_weights) > size
+        || !std::isfinite(header->lowerlimit) || !std::isfinite(header->upperlimit) || !(header->lowerlimit < header->upperlimit))
+    {
+        std::cerr << "shm_open " << name << " failed (not a model segment)" << std::endl;
+        munmap(mapping, size);
+        return nullptr;
+    }
+    return std::unique_ptr<SharedModel>(new SharedModel(name, mapping, size, false));
+}
+
+/**
+ * @brief Remove a segment name, mappings stay valid until they are unmapped
+ * @param name Segment name
+ * @return True if the name existed
+ */
+bool SharedModel::remove(const std::string& name)
+{
+    return shm_unlink(name.c_str()) == 0;
+}
+
+#else
+
+SharedModel::~SharedModel() {};
+
+/**
+ * @brief Shared memory segments need POSIX shm, not available on this platform
+ * @return nullptr
+ */
+std::unique_ptr<SharedModel> SharedModel::create(const std::string&, const CMAC&, float, float)
+{
+    return nullptr;
+}
+
+/**
+ * @brief Shared memory segments need POSIX shm, not available on this platform
+ * @return nullptr
+ */
+std::unique_ptr<SharedModel> SharedModel::open(const std::string&)
+{
+    return nullptr;
+}
+
+/**
+ * @brief Shared memory segments need POSIX shm, not available on this platform
+ * @return False
+ */
+bool SharedModel::remove(const std::string&)
+{
+    return false;
+}
+
+#endif
+
+/**
+ * @brief Copy all weights of the model into the segment (trainer only)
+ * @param model Model of the stored variant and shape
+ */
+void SharedModel::publish(const CMAC& model)
+{
+    publishRange(model, 0, header->num_weights);
+}
+
+/**
+ * @brief Copy a range of weights of the model into the segment (trainer only)
+ *
+ * @param model Model of the stored variant and shape
+ * @param first First weight index
+ * @param n Number of weights, ranges outside the segment or the model are ignored
+ */
+void SharedModel::publishRange(const CMAC& model, int first, int n)
+{
+    if (!writable || first < 0 || n < 0 || (int64_t)first + n > header->num_weights || (size_t)first + n > model.getWtVector().size())
+        return;
+    uint64_t generation = header->generation.load(std::memory_order_relaxed);
+    header->generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(weights + first, model.getWtVector().data() + first, n * sizeof(float));
+    header->generation.store(generation + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Predict a single input value from the shared weights, retrying if a publish overlapped
+ * Inputs are clamped to the input limits of the segment, since they index the weights directly.
+ *
+ * @param x Input value
+ * @param out Receives the predicted output value
+ * @param retries Receives the number of retried reads (may be nullptr)
+ * @return False if x is not finite or the generation stayed odd for max_read_retries reads
+ */
+bool SharedModel::predict(float x, float& out, uint64_t* retries = nullptr) const
+{
+    if (!std::isfinite(x))
+        return false;
+    x = std::min(std::max(x, header->lowerlimit), header->upperlimit);
+    for (int attempt = 0; attempt < max_read_retries; attempt++)
+    {
+        uint64_t before = header->generation.load(std::memory_order_acquire);
+        if (!(before & 1))
+        {
+            float res = shape->predictWith(weights, x, header->lowerlimit, header->upperlimit);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->generation.load(std::memory_order_relaxed) == before)
+            {
+                out = res;
+                return true;
+            }
+        }
+        else
+            std::this_thread::yield();
+        if (retries)
+            (*retries)++;
+    }
+    return false;
+}
+
+/**
+ * @brief Getter to get the generation counter (twice the number of completed publishes)
+ * @return Generation
+ */
+uint64_t SharedModel::getGeneration() const
+{
+    return header->generation.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Getter to get the number of stored weights
+ * @return Number of weights
+ */
+int SharedModel::getNumWeights() const
+{
+    return header->num_weights;
+}
@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Counter-based random numbers and in-place permutations of sample indices.
+ * Every draw is a pure function of (seed, epoch, counter), so an epoch's order can be
+ * regenerated anywhere (e.g. after resuming training) without carrying generator state.
+ */
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+uint64_t splitmix64(uint64_t x);
+uint32_t counterRandom(uint64_t seed, uint64_t epoch, uint64_t counter, uint32_t bound);
+void permute(std::vector<uint32_t>& order, size_t begin, size_t end, uint64_t seed, uint64_t epoch);
+void blockShuffle(const std::vector<uint32_t>& sorted_order, std::vector<uint32_t>& order, size_t block_size, uint64_t seed, uint64_t epoch);
+void bucketSort(const std::vector<uint32_t>& keys, std::vector<uint32_t>& order, std::vector<uint32_t>& bucket_starts);
+void bucketShuffle(const std::vector<uint32_t>& sorted_order, const std::vector<uint32_t>& bucket_starts, std::vector<uint32_t>& order, uint64_t seed, uint64_t epoch);
+
+//-----------------------------------------------------------
+
+/**
+ * @brief SplitMix64 finalizer, a bijective 64 bit mix
+ * @param x Input value
+ * @return Mixed value
+ */
+uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Uniform integer in [0, bound) for one (seed, epoch, counter) triple
+ *
+ * @param seed Run seed
+ * @param epoch Epoch number (stream)
+ * @param counter Draw number within the epoch
+ * @param bound Exclusive upper bound
+ * @return Random value
+ */
+uint32_t counterRandom(uint64_t seed, uint64_t epoch, uint64_t counter, uint32_t bound)
+{
+    uint64_t bits = splitmix64(splitmix64(seed ^ splitmix64(epoch)) + counter);
+    // Multiply-shift range reduction (bias below 2^-32 for the bounds used here)
+    return (uint32_t)(((bits >> 32) * (uint64_t)bound) >> 32);
+}
+
+/**
+ * @brief Fisher-Yates shuffle of order[begin, end)
+ *
+ * @param order Sample indices
+ * @param begin First position
+ * @param end One past the last position
+ * @param seed Run seed
+ * @param epoch Epoch number
+ */
+void permute(std::vector<uint32_t>& order, size_t begin, size_t end, uint64_t seed, uint64_t epoch)
+{
+    for (size_t i = end; i > begin + 1; i--)
+    {
+        size_t j = begin + counterRandom(seed, epoch, i, (uint32_t)(i - begin));
+        std::swap(order[i - 1], order[j]);
+    }
+}
+
+/**
+ * @brief Visit fixed size blocks of a locality sorted order in random order, shuffling inside each block
+ * Consecutive samples stay within block_size neighbours in weight space, so their active cells share cache lines.
+ *
+ * @param sorted_order Sample indices sorted by association index
+ * @param order Receives the epoch's order (same size as sorted_order)
+ * @param block_size Samples per block
+ * @param seed Run seed
+ * @param epoch Epoch number
+ */
+void blockShuffle(const std::vector<uint32_t>& sorted_order, std::vector<uint32_t>& order, size_t block_size, uint64_t seed, uint64_t epoch)
+{
+    size_t n = sorted_order.size();
+    block_size = std::max<size_t>(1, block_size);
+    size_t blocks = (n + block_size - 1) / block_size;
+
+    std::vector<uint32_t> block_order(blocks);
+    for (size_t b = 0; b < blocks; b++)
+        block_order[b] = (uint32_t)b;
+    // Separate stream for the block order so it does not correlate with the in-block shuffles
+    permute(block_order, 0, blocks, ~seed, epoch);
+
+    order.resize(n);
+    size_t pos = 0;
+    for (uint32_t b : block_order)
+    {
+        size_t first = b * block_size;
+        size_t last = std::min(n, first + block_size);
+        size_t start = pos;
+        for (size_t i = first; i < last; i++)
+            order[pos++] = sorted_order[i];
+        permute(order, start, pos, seed, epoch);
+    }
+}
+
+/**
+ * @brief Counting sort of sample indices by bucket key (stable, O(n + buckets))
+ *
+ * @param keys Bucket of every sample
+ * @param order Receives the sample indices in ascending bucket order
+ * @param bucket_starts Receives the first position of every non-empty bucket, followed by the total size
+ */
+void bucketSort(const std::vector<uint32_t>& keys, std::vector<uint32_t>& order, std::vector<uint32_t>& bucket_starts)
+{
+    uint32_t buckets = 0;
+    for (uint32_t key : keys)
+        buckets = std::max(buckets, key + 1);
+
+    std::vector<uint32_t> offsets(buckets + 1, 0);
+    for (uint32_t key : keys)
+        offsets[key + 1]++;
+    for (uint32_t b = 0; b < buckets; b++)
+        offsets[b + 1] += offsets[b];
+
+    bucket_starts.clear();
+    for (uint32_t b = 0; b < buckets; b++)
+        if (offsets[b + 1] > offsets[b])
+            bucket_starts.push_back(offsets[b]);
+    bucket_starts.push_back((uint32_t)keys.size());
+
+    order.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+        order[offsets[keys[i]]++] = (uint32_t)i;
+}
+
+/**
+ * @brief Visit the buckets of a bucket sorted order in ascending order, shuffling inside each bucket
+ *
+ * @param sorted_order Sample indices from bucketSort
+ * @param bucket_starts Bucket boundaries from bucketSort
+ * @param order Receives the epoch's order (same size as sorted_order)
+ * @param seed Run seed
+ * @param epoch Epoch number
+ */
+void bucketShuffle(const std::vector<uint32_t>& sorted_order, const std::vector<uint32_t>& bucket_starts, std::vector<uint32_t>& order, uint64_t seed, uint64_t epoch)
+{
+    order = sorted_order;
+    for (size_t b = 0; b + 1 < bucket_starts.size(); b++)
+        permute(order, bucket_starts[b], bucket_starts[b + 1], seed, epoch);
+}
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Read-copy-update publication of trained weights.
+ * A trainer thread trains its own CMAC and periodically publishes an immutable copy of the weights;
+ * inference threads read the latest copy wait-free. Replaced copies are freed by the publisher once
+ * no reader can still hold them (epoch-based reclamation).
+ */
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "cmac.h"
+
+/**
+ * @brief Immutable copy of the weights of a model at one point of training
+ */
+struct ModelSnapshot
+{
+    const CMAC* model;              // Shape and variant, must outlive the snapshot
+    WeightVector weights;
+    uint64_t version;               // Number of publications before this one
+    int epoch;                      // Epochs trained when published
+
+    float predict(float x, float lowerlimit, float upperlimit) const;
+};
+
+/**
+ * @brief Per reader epoch announcement, one cache line each so readers never share a line
+ */
+struct alignas(64) SnapshotReaderSlot
+{
+    std::atomic<uint64_t> epoch;    // Global epoch seen on entry, 0 while outside a read section
+    std::atomic<bool> in_use;
+};
+
+/**
+ * @brief Snapshot Publisher Class
+ * Single writer (the trainer), any number of registered readers up to max_readers.
+ */
+class SnapshotPublisher
+{
+public:
+    static const int max_readers = 64;
+
+private:
+    std::atomic<ModelSnapshot*> current;
+    std::atomic<uint64_t> global_epoch;
+    SnapshotReaderSlot slots[max_readers];
+    std::vector<std::pair<ModelSnapshot*, uint64_t>> retired;   // Writer only
+    uint64_t published;
+
+    void reclaim();
+
+public:
+    SnapshotPublisher();
+    ~SnapshotPublisher();
+    void publish(const CMAC& model);
+    int registerReader();
+    void unregisterReader(int reader);
+    const ModelSnapshot* enter(int reader);
+    void exit(int reader);
+    size_t getRetiredCount() const;
+};
+
+/**
+ * @brief RAII read section pinning the latest snapshot
+ */
+class SnapshotGuard
+{
+private:
+    SnapshotPublisher& publisher;
+    int reader;
+    const ModelSnapshot* snapshot;
+
+public:
+    SnapshotGuard(SnapshotPublisher& publisher, int reader);
+    ~SnapshotGuard();
+    const ModelSnapshot* get() const;
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Predict a single input value from the snapshot weights
+ *
+ * @param x Input value
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return Predicted output value
+ */
+float ModelSnapshot::predict(float x, float lowerlimit, float upperlimit) const
+{
+    return model->predictWith(weights.data(), x, lowerlimit, upperlimit);
+}
+
+/**
+ * @brief Initialize the SnapshotPublisher class with nothing published
+ */
+SnapshotPublisher::SnapshotPublisher() : current(nullptr), global_epoch(1), published(0)
+{
+    for (int i = 0; i < max_readers; i++)
+    {
+        slots[i].epoch.store(0);
+        slots[i].in_use.store(false);
+    }
+}
+
+/**
+ * @brief Free every snapshot, readers must have stopped
+ */
+SnapshotPublisher::~SnapshotPublisher()
+{
+    delete current.load();
+    for (auto& entry : retired)
+        delete entry.first;
+}
+
+/**
+ * @brief Publish a copy of the current weights of a model (trainer thread only)
+ * Must not run concurrently with training steps on the same model.
+ *
+ * @param model Model being trained
+ */
+void SnapshotPublisher::publish(const CMAC& model)
+{
+    ModelSnapshot* snapshot = new ModelSnapshot{ &model, model.getWtVector(), published++, model.getEpochsTrained() };
+    ModelSnapshot* old = current.exchange(snapshot);
+    if (old)
+        retired.push_back({ old, global_epoch.load() });
+    global_epoch.fetch_add(1);
+    reclaim();
+}
+
+/**
+ * @brief Free retired snapshots that no reader can still hold
+ * A reader that announced epoch e may hold any snapshot retired at epoch e or later.
+ */
+void SnapshotPublisher::reclaim()
+{
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < max_readers; i++)
+    {
+        uint64_t epoch = slots[i].epoch.load();
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+
+    size_t kept = 0;
+    for (auto& entry : retired)
+    {
+        if (entry.second < oldest)
+            delete entry.first;
+        else
+            retired[kept++] = entry;
+    }
+    retired.resize(kept);
+}
+
+/**
+ * @brief Claim a reader slot
+ * @return Reader id, or -1 if all max_readers slots are taken
+ */
+int SnapshotPublisher::registerReader()
+{
+    for (int i = 0; i < max_readers; i++)
+    {
+        bool expected = false;
+        if (slots[i].in_use.compare_exchange_strong(expected, true))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Release a reader slot (outside of any read section)
+ * @param reader Reader id
+ */
+void SnapshotPublisher::unregisterReader(int reader)
+{
+    slots[reader].epoch.store(0);
+    slots[reader].in_use.store(false);
+}
+
+/**
+ * @brief Start a read section and return the latest snapshot (wait-free)
+ * The snapshot stays valid until exit is called with the same reader id.
+ *
+ * @param reader Reader id
+ * @return Latest snapshot (nullptr before the first publish)
+ */
+const ModelSnapshot* SnapshotPublisher::enter(int reader)
+{
+    // The announcement must be visible before the pointer is read (store-load ordering)
+    slots[reader].epoch.store(global_epoch.load());
+    return current.load();
+}
+
+/**
+ * @brief End a read section
+ * @param reader Reader id
+ */
+void SnapshotPublisher::exit(int reader)
+{
+    slots[reader].epoch.store(0, std::memory_order_release);
+}
+
+/**
+ * @brief Getter to get the number of replaced snapshots not yet freed (writer thread only)
+ * @return Retired snapshot count
+ */
+size_t SnapshotPublisher::getRetiredCount() const
+{
+    return retired.size();
+}
+
+/**
+ * @brief Initialize the SnapshotGuard class and enter a read section
+ *
+ * @param publisher Snapshot publisher
+ * @param reader Reader id from registerReader
+ */
+SnapshotGuard::SnapshotGuard(SnapshotPublisher& publisher, int reader) : publisher(publisher), reader(reader)
+{
+    snapshot = publisher.enter(reader);
+}
+
+/**
+ * @brief Leave the read section
+ */
+SnapshotGuard::~SnapshotGuard()
+{
+    publisher.exit(reader);
+}
+
+/**
+ * @brief Getter to get the pinned snapshot
+ * @return Snapshot (nullptr before the first publish)
+ */
+const ModelSnapshot* SnapshotGuard::get() const
+{
+    return snapshot;
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief Read-only view over a contiguous sequence (minimal stand-in for C++20 std::span)
+ * Lets evaluation code take a dataset, a slice of it or a raw buffer without copying.
+ */
+template <typename T>
+class Span
+{
+private:
+    const T* ptr;
+    size_t count;
+
+public:
+    Span() : ptr(nullptr), count(0) {};
+    Span(const T* data, size_t size) : ptr(data), count(size) {};
+    template <typename Allocator> Span(const std::vector<T, Allocator>& data) : ptr(data.data()), count(data.size()) {};
+
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+
+    /**
+     * @brief View of a sub range
+     *
+     * @param offset First element of the sub range
+     * @param size Number of elements (clamped to the end of the view)
+     * @return Sub range view
+     */
+    Span subspan(size_t offset, size_t size) const
+    {
+        if (offset > count)
+            offset = count;
+        if (size > count - offset)
+            size = count - offset;
+        return Span(ptr + offset, size);
+    }
+};
@@ -0,0 +1,375 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include "cmac.h"
+#include "thread_pool.h"
+
+/**
+ * @brief One hyperparameter configuration of the sweep
+ */
+struct SweepConfig
+{
+    std::string variant;    // "discrete" or "continous"
+    int gen_factor;
+    int num_weights;
+    float lr;
+};
+
+/**
+ * @brief Cartesian grid of hyperparameters to sweep over
+ */
+struct SweepGrid
+{
+    std::vector<std::string> variants;
+    std::vector<int> gen_factors;
+    std::vector<int> num_weights;
+    std::vector<float> lrs;
+
+    std::vector<SweepConfig> expand() const;
+};
+
+/**
+ * @brief Training and pruning settings shared by every configuration
+ */
+struct SweepSettings
+{
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+    int epochs = 2000;
+    float convergenceThreshold = 0.00000000001;
+    int grace_epochs = 50;      // Never prune before this many epochs
+    float prune_ratio = 2.0;    // Prune when loss exceeds prune_ratio x best loss seen at the same epoch (0 disables)
+    size_t threads = std::thread::hardware_concurrency();
+};
+
+/**
+ * @brief Rung schedule of the successive halving scheduler
+ */
+struct HalvingSettings
+{
+    int min_epochs = 25;    // Epochs every configuration gets in the first rung
+    int reduction = 2;      // Keep 1/reduction of the configurations per rung and grow the rung budget by the same factor
+    float validation_fraction = 0.2f;   // Tail of the train data held out to rank the runs (the test data is never used to choose)
+};
+
+enum class SweepStatus { Converged, MaxEpochs, Pruned };
+
+/**
+ * @brief Outcome of one configuration
+ */
+struct SweepResult
+{
+    SweepConfig config;
+    int epochs;
+    double convergence_ms;
+    float train_accuracy;
+    float test_accuracy;
+    SweepStatus status;
+};
+
+/**
+ * @brief Parallel Hyperparameter Sweep Class
+ * Trains every configuration of a grid concurrently on a work stealing pool. All runs read
+ * the same train/test vectors, and a run is pruned once its loss falls too far behind the
+ * best loss any run has reached at the same epoch.
+ */
+class HyperparameterSweep
+{
+private:
+    SweepGrid grid;
+    SweepSettings settings;
+
+public:
+    HyperparameterSweep(SweepGrid grid, SweepSettings settings);
+    std::vector<SweepResult> run(const std::vector<std::pair<float, float>>& train, const std::vector<std::pair<float, float>>& test);
+    static void printTable(std::ostream& out, const std::vector<SweepResult>& results);
+};
+
+/**
+ * @brief Successive Halving Scheduler Class
+ * Trains every configuration for a short rung using the resumable training API, ranks the
+ * runs by their loss on a validation split of the train data, drops the worst ones and resumes the survivors with a larger budget
+ * until a single configuration (or none) is left to finish.
+ */
+class SuccessiveHalving
+{
+private:
+    SweepGrid grid;
+    SweepSettings settings;
+    HalvingSettings halving;
+
+public:
+    SuccessiveHalving(SweepGrid grid, SweepSettings settings, HalvingSettings halving);
+    std::vector<SweepResult> run(const std::vector<std::pair<float, float>>& train, const std::vector<std::pair<float, float>>& test);
+};
+
+float heldOutLoss(const CMAC& model, const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit);
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Expand the grid into the list of valid configurations
+ * Configurations with fewer than three association cells are skipped (the proportionate hash needs them).
+ *
+ * @return Every valid configuration
+ */
+std::vector<SweepConfig> SweepGrid::expand() const
+{
+    std::vector<SweepConfig> configs;
+    for (auto& variant : variants)
+        for (int gf : gen_factors)
+            for (int nw : num_weights)
+            {
+                if (gf < 1 || nw + 1 - gf < 3)
+                    continue;
+                for (float lr : lrs)
+                    configs.push_back({ variant, gf, nw, lr });
+            }
+    return configs;
+}
+
+/**
+ * @brief Initialize the HyperparameterSweep class
+ *
+ * @param grid Hyperparameter grid
+ * @param settings Training and pruning settings
+ */
+HyperparameterSweep::HyperparameterSweep(SweepGrid grid, SweepSettings settings) : grid(grid), settings(settings) {};
+
+/**
+ * @brief Train every configuration of the grid
+ *
+ * @param train Continer of the input and output train data (shared read-only by all runs)
+ * @param test Continer of the input and output test data (shared read-only by all runs)
+ * @return One result per configuration, in grid order
+ */
+std::vector<SweepResult> HyperparameterSweep::run(const std::vector<std::pair<float, float>>& train, const std::vector<std::pair<float, float>>& test)
+{
+    std::vector<SweepConfig> configs = grid.expand();
+    std::vector<SweepResult> results(configs.size());
+
+    // Best training loss reached by any run at each epoch
+    int max_epoch = settings.epochs + 1;
+    std::unique_ptr<std::atomic<float>[]> best_loss(new std::atomic<float>[max_epoch + 1]);
+    for (int e = 0; e <= max_epoch; e++)
+        best_loss[e].store(std::numeric_limits<float>::infinity(), std::memory_order_relaxed);
+
+    WorkStealingPool pool(settings.threads);
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        pool.submit([&, i]() {
+            CMAC_TRACE_SCOPE("sweep config");
+            const SweepConfig& config = configs[i];
+            std::unique_ptr<CMAC> model = createCMAC(config.variant, config.gen_factor, config.num_weights);
+            bool pruned = false;
+
+            model->setEpochCallback([&](int epoch, float loss) {
+                std::atomic<float>& best = best_loss[std::min(epoch, max_epoch)];
+                float current = best.load(std::memory_order_relaxed);
+                while (loss < current && !best.compare_exchange_weak(current, loss, std::memory_order_relaxed))
+                    ;
+                if (settings.prune_ratio > 0 && epoch >= settings.grace_epochs && loss > settings.prune_ratio * best.load(std::memory_order_relaxed))
+                    pruned = true;
+                // A diverged run never recovers
+                if (std::isnan(loss))
+                    pruned = true;
+                return !pruned;
+            });
+
+            auto t_start = std::chrono::steady_clock::now();
+            model->train(train, settings.lowerlimit, settings.upperlimit, settings.epochs, config.lr, settings.convergenceThreshold);
+            auto t_end = std::chrono::steady_clock::now();
+
+            float train_accuracy = 0, test_accuracy = 0;
+            model->predict(train, settings.lowerlimit, settings.upperlimit, train_accuracy, false);
+            model->predict(test, settings.lowerlimit, settings.upperlimit, test_accuracy, false);
+
+            SweepStatus status = pruned ? SweepStatus::Pruned : (model->getEpochsTrained() > settings.epochs ? SweepStatus::MaxEpochs : SweepStatus::Converged);
+            results[i] = { config, model->getEpochsTrained(), std::chrono::duration<double, std::milli>(t_end - t_start).count(), train_accuracy, test_accuracy, status };
+        });
+    }
+    pool.wait();
+    return results;
+}
+
+/**
+ * @brief Print convergence time against test accuracy, best test accuracy first
+ *
+ * @param out Output stream
+ * @param results Sweep results
+ */
+void HyperparameterSweep::printTable(std::ostream& out, const std::vector<SweepResult>& results)
+{
+    std::vector<SweepResult> sorted = results;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const SweepResult& a, const SweepResult& b) {
+        // NaN accuracies (diverged runs) sort last
+        if (std::isnan(a.test_accuracy) || std::isnan(b.test_accuracy))
+            return !std::isnan(a.test_accuracy) && std::isnan(b.test_accuracy);
+        return a.test_accuracy > b.test_accuracy;
+    });
+
+    out << std::left << std::setw(11) << "variant" << std::right << std::setw(5) << "gf" << std::setw(8) << "weights" << std::setw(10) << "lr"
+        << std::setw(8) << "epochs" << std::setw(12) << "time(ms)" << std::setw(11) << "train_acc" << std::setw(10) << "test_acc" << "  status\n";
+    for (auto& r : sorted)
+    {
+        const char* status = r.status == SweepStatus::Pruned ? "pruned" : (r.status == SweepStatus::MaxEpochs ? "max_epochs" : "converged");
+        out << std::left << std::setw(11) << r.config.variant << std::right << std::setw(5) << r.config.gen_factor << std::setw(8) << r.config.num_weights
+            << std::setw(10) << r.config.lr << std::setw(8) << r.epochs << std::setw(12) << std::fixed << std::setprecision(3) << r.convergence_ms
+            << std::setw(11) << std::setprecision(4) << r.train_accuracy << std::setw(10) << r.test_accuracy << "  " << status << '\n';
+        out.unsetf(std::ios::fixed);
+        out << std::setprecision(6);
+    }
+}
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Root mean squared error of a model on data it was not trained on
+ * Uses predictPoint, so the association map of a paused training run is left untouched.
+ *
+ * @param model Model to evaluate
+ * @param data Continer of the input and output held-out data
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ * @return RMSE
+ */
+float heldOutLoss(const CMAC& model, const std::vector<std::pair<float, float>>& data, float lowerlimit, float upperlimit)
+{
+    double sum = 0;
+    for (auto& sample : data)
+    {
+        double error = sample.second - model.predictPoint(sample.first, lowerlimit, upperlimit);
+        sum += error * error;
+    }
+    return data.empty() ? 0 : (float)sqrt(sum / data.size());
+}
+
+/**
+ * @brief Initialize the SuccessiveHalving class
+ *
+ * @param grid Hyperparameter grid
+ * @param settings Training settings (prune_ratio and grace_epochs are not used)
+ * @param halving Rung schedule
+ */
+SuccessiveHalving::SuccessiveHalving(SweepGrid grid, SweepSettings settings, HalvingSettings halving) : grid(grid), settings(settings), halving(halving) {};
+
+/**
+ * @brief Run the successive halving schedule over every configuration of the grid
+ *
+ * @param train Continer of the input and output train data (shared read-only by all runs), its
+ *              last validation_fraction is held out to rank the runs and not trained on
+ * @param test Continer of the input and output held-out data, only used for the reported test accuracy
+ * @return One result per configuration, in grid order
+ */
+std::vector<SweepResult> SuccessiveHalving::run(const std::vector<std::pair<float, float>>& train, const std::vector<std::pair<float, float>>& test)
+{
+    size_t validation_size = std::min(train.size() / 2, (size_t)std::ceil(train.size() * halving.validation_fraction));
+    std::vector<std::pair<float, float>> fit(train.begin(), train.end() - validation_size);
+    std::vector<std::pair<float, float>> validation(train.end() - validation_size, train.end());
+
+    std::vector<SweepConfig> configs = grid.expand();
+    std::vector<std::unique_ptr<CMAC>> models(configs.size());
+    std::vector<double> elapsed_ms(configs.size(), 0);
+    std::vector<float> rank_loss(configs.size(), 0);
+    std::vector<SweepStatus> status(configs.size(), SweepStatus::MaxEpochs);
+
+    int max_epochs = settings.epochs + 1;
+    int reduction = std::max(2, halving.reduction);
+    int rung_epochs = std::max(1, halving.min_epochs);
+
+    std::vector<size_t> active(configs.size());
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        models[i] = createCMAC(configs[i].variant, configs[i].gen_factor, configs[i].num_weights);
+        active[i] = i;
+    }
+
+    WorkStealingPool pool(settings.threads);
+    bool first_rung = true;
+    while (!active.empty())
+    {
+        // The last survivor is trained to completion
+        int budget = active.size() == 1 ? max_epochs : rung_epochs;
+
+        for (size_t i : active)
+        {
+            pool.submit([&, i, budget, first_rung]() {
+                CMAC_TRACE_SCOPE("halving rung");
+                CMAC& model = *models[i];
+                auto t_start = std::chrono::steady_clock::now();
+                if (first_rung)
+                    model.beginTraining(fit, settings.lowerlimit, settings.upperlimit);
+                model.trainEpochs(fit, std::min(budget, max_epochs) - model.getEpochsTrained(), configs[i].lr, settings.convergenceThreshold);
+                elapsed_ms[i] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+                rank_loss[i] = heldOutLoss(model, validation, settings.lowerlimit, settings.upperlimit);
+            });
+        }
+        pool.wait();
+        first_rung = false;
+
+        // Finished runs leave the schedule with their own status
+        std::vector<size_t> remaining;
+        for (size_t i : active)
+        {
+            if (models[i]->isConverged())
+                status[i] = SweepStatus::Converged;
+            else if (models[i]->getEpochsTrained() < max_epochs)
+                remaining.push_back(i);
+        }
+
+        if (remaining.size() > 1)
+        {
+            std::stable_sort(remaining.begin(), remaining.end(), [&](size_t a, size_t b) {
+                if (std::isnan(rank_loss[a]) || std::isnan(rank_loss[b]))
+                    return !std::isnan(rank_loss[a]) && std::isnan(rank_loss[b]);
+                return rank_loss[a] < rank_loss[b];
+            });
+            size_t keep = (remaining.size() + reduction - 1) / reduction;
+            for (size_t k = keep; k < remaining.size(); k++)
+                status[remaining[k]] = SweepStatus::Pruned;
+            remaining.resize(keep);
+        }
+        active = remaining;
+        rung_epochs *= reduction;
+    }
+
+    std::vector<SweepResult> results(configs.size());
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        float train_accuracy = 0, test_accuracy = 0;
+        models[i]->predict(fit, settings.lowerlimit, settings.upperlimit, train_accuracy, false);
+        models[i]->predict(test, settings.lowerlimit, settings.upperlimit, test_accuracy, false);
+        results[i] = { configs[i], models[i]->getEpochsTrained(), elapsed_ms[i], train_accuracy, test_accuracy, status[i] };
+    }
+    return results;
+}
@@ -0,0 +1,331 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include "perf_counters.h"
+
+/**
+ * @brief One training epoch worth of telemetry
+ * Plain data so that publishing a record from the training loop is a handful of stores
+ */
+struct EpochRecord
+{
+    const char* tag;        // Static name of the model that produced the record
+    int epoch;
+    float loss;
+    float accuracy;
+    int64_t elapsed_ns;     // Time since the start of training
+#if CMAC_PERF_ENABLED
+    PerfCounts phases[PERF_PHASE_COUNT];    // Hardware counters per training phase during this epoch
+#endif
+};
+
+/**
+ * @brief Base Telemetry Formatter Class
+ * Turns drained epoch records into some output representation
+ */
+class TelemetryFormatter
+{
+public:
+    virtual ~TelemetryFormatter() = default;
+    virtual void write(const EpochRecord& record) = 0;
+    virtual void flush() {};
+};
+
+/**
+ * @brief Human readable formatter writing to the console
+ */
+class ConsoleFormatter : public TelemetryFormatter
+{
+public:
+    void write(const EpochRecord& record);
+    void flush();
+};
+
+/**
+ * @brief Comma separated formatter writing one row per epoch
+ */
+class CSVFormatter : public TelemetryFormatter
+{
+private:
+    std::ofstream file;
+
+public:
+    CSVFormatter(std::string path);
+    void write(const EpochRecord& record);
+    void flush();
+};
+
+/**
+ * @brief Binary formatter writing fixed size little endian records
+ * Layout per record: int32 epoch, float32 loss, float32 accuracy, int64 elapsed_ns (tag is not stored),
+ * followed by PERF_PHASE_COUNT x 5 uint64 counters when built with CMAC_PERF_COUNTERS
+ */
+class BinaryFormatter : public TelemetryFormatter
+{
+private:
+    std::ofstream file;
+
+public:
+    BinaryFormatter(std::string path);
+    void write(const EpochRecord& record);
+    void flush();
+};
+
+/**
+ * @brief Asynchronous Telemetry Sink Class
+ * Single producer / single consumer lock-free ring buffer drained by a background thread.
+ * The training loop only pushes records; all formatting and I/O happen on the drain thread.
+ */
+class TelemetrySink
+{
+private:
+    std::vector<EpochRecord> ring;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;     // Next slot to write (producer owned)
+    alignas(64) std::atomic<size_t> tail;     // Next slot to read (consumer owned)
+    alignas(64) std::atomic<bool> running;
+    std::atomic<uint64_t> dropped;
+    std::unique_ptr<TelemetryFormatter> formatter;
+    std::thread worker;
+
+    void drain();
+
+public:
+    TelemetrySink(std::unique_ptr<TelemetryFormatter> formatter, size_t capacity = 4096);
+    ~TelemetrySink();
+    bool push(const EpochRecord& record);
+    uint64_t getDroppedCount();
+    void waitUntilDrained();
+    void stop();
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Write a record in the classic training progress format
+ * @param record Epoch record
+ */
+void ConsoleFormatter::write(const EpochRecord& record)
+{
+    std::cout << record.tag << " Training in Progress: " << " Epoch: " << record.epoch << " Accuracy: " << record.accuracy * 100 << " Error: " << record.loss << '\n';
+#if CMAC_PERF_ENABLED
+    const char* names[PERF_PHASE_COUNT] = { "update", "evaluate", "association" };
+    for (int p = 0; p < PERF_PHASE_COUNT; p++)
+    {
+        const PerfCounts& c = record.phases[p];
+        if (c.uncounted_scopes)
+            std::cout << "    " << names[p] << ": counters not scheduled in " << c.uncounted_scopes << " scopes, counts incomplete" << '\n';
+        if (!c.cycles)
+            continue;
+        std::cout << "    " << names[p] << ": cycles " << c.cycles << " IPC " << (double)c.instructions / c.cycles
+                  << " L1D misses " << c.l1d_misses << " LLC misses " << c.llc_misses << " branch misses " << c.branch_misses
+                  << " dTLB misses " << c.dtlb_misses << '\n';
+    }
+#endif
+}
+
+/**
+ * @brief Flush the console stream
+ */
+void ConsoleFormatter::flush()
+{
+    std::cout.flush();
+}
+
+/**
+ * @brief Initialize the CSVFormatter class
+ * @param path Output file path
+ */
+CSVFormatter::CSVFormatter(std::string path) : file(path)
+{
+    file << "model,epoch,loss,accuracy,elapsed_ns";
+#if CMAC_PERF_ENABLED
+    const char* names[PERF_PHASE_COUNT] = { "update", "evaluate", "association" };
+    for (int p = 0; p < PERF_PHASE_COUNT; p++)
+        file << ',' << names[p] << "_cycles," << names[p] << "_instructions," << names[p] << "_l1d_misses," << names[p] << "_llc_misses," << names[p] << "_branch_misses," << names[p] << "_dtlb_misses," << names[p] << "_uncounted_scopes";
+#endif
+    file << '\n';
+}
+
+/**
+ * @brief Write a record as a CSV row
+ * @param record Epoch record
+ */
+void CSVFormatter::write(const EpochRecord& record)
+{
+    file << record.tag << ',' << record.epoch << ',' << record.loss << ',' << record.accuracy << ',' << record.elapsed_ns;
+#if CMAC_PERF_ENABLED
+    for (int p = 0; p < PERF_PHASE_COUNT; p++)
+    {
+        const PerfCounts& c = record.phases[p];
+        file << ',' << c.cycles << ',' << c.instructions << ',' << c.l1d_misses << ',' << c.llc_misses << ',' << c.branch_misses << ',' << c.dtlb_misses << ',' << c.uncounted_scopes;
+    }
+#endif
+    file << '\n';
+}
+
+/**
+ * @brief Flush the CSV file
+ */
+void CSVFormatter::flush()
+{
+    file.flush();
+}
+
+/**
+ * @brief Initialize the BinaryFormatter class
+ * @param path Output file path
+ */
+BinaryFormatter::BinaryFormatter(std::string path) : file(path, std::ios::binary) {};
+
+/**
+ * @brief Write a record as a fixed size binary blob
+ * @param record Epoch record
+ */
+void BinaryFormatter::write(const EpochRecord& record)
+{
+    int32_t epoch = record.epoch;
+    file.write(reinterpret_cast<const char*>(&epoch), sizeof(epoch));
+    file.write(reinterpret_cast<const char*>(&record.loss), sizeof(record.loss));
+    file.write(reinterpret_cast<const char*>(&record.accuracy), sizeof(record.accuracy));
+    file.write(reinterpret_cast<const char*>(&record.elapsed_ns), sizeof(record.elapsed_ns));
+#if CMAC_PERF_ENABLED
+    file.write(reinterpret_cast<const char*>(record.phases), sizeof(record.phases));
+#endif
+}
+
+/**
+ * @brief Flush the binary file
+ */
+void BinaryFormatter::flush()
+{
+    file.flush();
+}
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the TelemetrySink class and start the drain thread
+ *
+ * @param formatter Formatter used for every drained record
+ * @param capacity Ring buffer capacity (rounded up to a power of two)
+ */
+TelemetrySink::TelemetrySink(std::unique_ptr<TelemetryFormatter> formatter, size_t capacity) : head(0), tail(0), running(true), dropped(0), formatter(std::move(formatter))
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    ring.resize(size);
+    mask = size - 1;
+    worker = std::thread(&TelemetrySink::drain, this);
+}
+
+/**
+ * @brief Stop the drain thread after writing out every pending record
+ */
+TelemetrySink::~TelemetrySink()
+{
+    stop();
+}
+
+/**
+ * @brief Publish a record from the producer thread (never blocks)
+ *
+ * @param record Epoch record
+ * @return False if the ring was full and the record was dropped
+ */
+bool TelemetrySink::push(const EpochRecord& record)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    ring[h & mask] = record;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Getter to get the number of records dropped because the ring was full
+ * @return Dropped record count
+ */
+uint64_t TelemetrySink::getDroppedCount()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Block the caller until every record pushed so far has been written out
+ */
+void TelemetrySink::waitUntilDrained()
+{
+    while (running.load(std::memory_order_acquire) && tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed))
+        std::this_thread::yield();
+}
+
+/**
+ * @brief Stop the drain thread and flush the formatter
+ */
+void TelemetrySink::stop()
+{
+    if (!running.exchange(false))
+        return;
+    if (worker.joinable())
+        worker.join();
+}
+
+/**
+ * @brief Drain loop run on the background thread
+ */
+void TelemetrySink::drain()
+{
+    while (true)
+    {
+        bool active = running.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+
+        bool written = t != h;
+        for (; t != h; t++)
+            formatter->write(ring[t & mask]);
+        tail.store(t, std::memory_order_release);
+
+        if (!active)
+            break;
+        if (written)
+            formatter->flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    formatter->flush();
+}
@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+/**
+ * @brief Work Stealing Thread Pool Class
+ * Every worker owns a task deque: it pops its own newest task first and, when idle,
+ * steals the oldest task of another worker. Training runs of very different length
+ * (e.g. gf=1 vs gf=30) therefore keep every core busy until the sweep drains.
+ */
+class WorkStealingPool
+{
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex state_mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    std::atomic<size_t> next_queue;
+    size_t pending;
+    bool stopping;
+
+    bool popTask(size_t index, std::function<void()>& task);
+    void workerLoop(size_t index);
+
+public:
+    WorkStealingPool(size_t threads = std::thread::hardware_concurrency());
+    ~WorkStealingPool();
+    void submit(std::function<void()> task);
+    void wait();
+    size_t getThreadCount() const;
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the WorkStealingPool class and start the workers
+ * @param threads Number of worker threads (at least one)
+ */
+WorkStealingPool::WorkStealingPool(size_t threads) : next_queue(0), pending(0), stopping(false)
+{
+    if (threads == 0)
+        threads = 1;
+    for (size_t i = 0; i < threads; i++)
+        queues.emplace_back(new WorkerQueue());
+    for (size_t i = 0; i < threads; i++)
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+/**
+ * @brief Finish every queued task and stop the workers
+ */
+WorkStealingPool::~WorkStealingPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+/**
+ * @brief Queue a task, spreading submissions round robin over the worker deques
+ * @param task Callable to run on the pool
+ */
+void WorkStealingPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        pending++;
+    }
+    size_t index = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    work_available.notify_one();
+}
+
+/**
+ * @brief Block until every submitted task has finished
+ */
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    work_done.wait(lock, [this]() { return pending == 0; });
+}
+
+/**
+ * @brief Getter to get the number of worker threads
+ * @return Thread count
+ */
+size_t WorkStealingPool::getThreadCount() const
+{
+    return workers.size();
+}
+
+/**
+ * @brief Take the newest local task or steal the oldest task of another worker
+ *
+ * @param index Index of the calling worker
+ * @param task Receives the task
+ * @return True if a task was found
+ */
+bool WorkStealingPool::popTask(size_t index, std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        if (!queues[index]->tasks.empty())
+        {
+            task = std::move(queues[index]->tasks.back());
+            queues[index]->tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); offset++)
+    {
+        WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Worker thread main loop
+ * @param index Index of this worker's deque
+ */
+void WorkStealingPool::workerLoop(size_t index)
+{
+    while (true)
+    {
+        std::function<void()> task;
+        if (popTask(index, task))
+        {
+            task();
+            std::lock_guard<std::mutex> lock(state_mutex);
+            if (--pending == 0)
+                work_done.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+        if (stopping)
+            return;
+        // Timed wait: a task queued between the scan above and this wait is picked up on the next pass
+        work_available.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
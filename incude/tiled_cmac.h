@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Morton (Z-order) cell indexing and a CMAC with two dimensional tilings.
+ * Row-major indexing puts vertical neighbours a whole row apart, so a trajectory that moves
+ * smoothly through the input plane lands on a new cache line (and soon a new page) at almost
+ * every step unless it moves along x. Morton order interleaves the bits of the two coordinates:
+ * a 64 byte line holds a 4 x 4 block of cells and every aligned 2^k x 2^k square is contiguous.
+ * The interleave uses pdep when built for BMI2 (-mbmi2, -march=haswell or later) and a 256
+ * entry lookup table otherwise.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "cmac.h"
+#if defined(__BMI2__)
+#include <immintrin.h>
+#define CMAC_MORTON_BMI2 1
+#endif
+
+/**
+ * @brief Placement of the cells of a tiling in its block of the weight vector
+ */
+enum CellLayout
+{
+    LAYOUT_ROW_MAJOR = 0,       // cell (ix, iy) at iy * side + ix
+    LAYOUT_MORTON               // cell (ix, iy) at the interleave of the bits of ix and iy
+};
+
+uint32_t mortonEncodeTable(uint32_t x, uint32_t y);
+uint32_t mortonEncode(uint32_t x, uint32_t y);
+const char* cellLayoutName(CellLayout layout);
+
+/**
+ * @brief Two Dimensional Tiled CMAC Class
+ * num_tilings grids of side x side cells over [lowerlimit, upperlimit)^2, each shifted by a
+ * fraction of a cell. An input activates one cell per tiling, and the prediction is the sum of
+ * their weights. Every tiling's block is a power of two square, a whole number of cache lines.
+ */
+class TiledCMAC2D
+{
+private:
+    int num_tilings;
+    int resolution;                     // Cells across the input range
+    int side;                           // Cells per row of a tiling, resolution + 1 rounded up to a power of two
+    size_t cells_per_tiling;
+    float lowerlimit;
+    float upperlimit;
+    CellLayout layout;
+    WeightVector weights;
+
+public:
+    static constexpr int max_tilings = 64;
+
+    TiledCMAC2D(int num_tilings, int resolution, float lowerlimit, float upperlimit, CellLayout layout);
+    int getNumTilings() const;
+    int getResolution() const;
+    CellLayout getLayout() const;
+    const WeightVector& getWeights() const;
+    size_t cellIndex(int tiling, uint32_t ix, uint32_t iy) const;
+    void getActiveCells(float x, float y, size_t* cells) const;
+    float predict(float x, float y) const;
+    void learn(float x, float y, float target, float lr);
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Interleave the low 16 bits of two coordinates with a table of spread bytes
+ *
+ * @param x Coordinate placed in the even bits
+ * @param y Coordinate placed in the odd bits
+ * @return Morton code
+ */
+uint32_t mortonEncodeTable(uint32_t x, uint32_t y)
+{
+    // spread[b] has bit i of b at bit 2i
+    static const struct SpreadTable
+    {
+        uint16_t spread[256];
+        SpreadTable()
+        {
+            for (int b = 0; b < 256; b++)
+            {
+                spread[b] = 0;
+                for (int i = 0; i < 8; i++)
+                    spread[b] |= ((b >> i) & 1) << (2 * i);
+            }
+        }
+    } table;
+
+    uint32_t even = table.spread[x & 0xff] | (uint32_t)table.spread[(x >> 8) & 0xff] << 16;
+    uint32_t odd = table.spread[y & 0xff] | (uint32_t)table.spread[(y >> 8) & 0xff] << 16;
+    return even | odd << 1;
+}
+
+/**
+ * @brief Interleave the low 16 bits of two coordinates (pdep with BMI2, else the table)
+ *
+ * @param x Coordinate placed in the even bits
+ * @param y Coordinate placed in the odd bits
+ * @return Morton code
+ */
+uint32_t mortonEncode(uint32_t x, uint32_t y)
+{
+#ifdef CMAC_MORTON_BMI2
+    return _pdep_u32(x, 0x55555555) | _pdep_u32(y, 0xaaaaaaaa);
+#else
+    return mortonEncodeTable(x, y);
+#endif
+}
+
+/**
+ * @brief Name of a cell layout
+ * @param layout Layout
+ * @return "row-major" or "morton"
+ */
+const char* cellLayoutName(CellLayout layout)
+{
+    return layout == LAYOUT_MORTON ? "morton" : "row-major";
+}
+
+/**
+ * @brief Initialize the TiledCMAC2D class with every weight at 0
+ *
+ * @param num_tilings Number of tilings (active cells per input), clamped to [1, max_tilings]
+ * @param resolution Cells across the input range of each dimension, clamped to [1, 65535] (16 bit Morton coordinates)
+ * @param lowerlimit Lowerlimit value of both inputs
+ * @param upperlimit Uperlimit value of both inputs
+ * @param layout Placement of the cells of each tiling
+ */
+TiledCMAC2D::TiledCMAC2D(int num_tilings, int resolution, float lowerlimit, float upperlimit, CellLayout layout = LAYOUT_MORTON) :
+    num_tilings(std::min(std::max(num_tilings, 1), max_tilings)), resolution(std::min(std::max(resolution, 1), 65535)), lowerlimit(lowerlimit), upperlimit(upperlimit), layout(layout)
+{
+    // The shifted tilings reach one cell past the range
+    side = 4;
+    while (side < this->resolution + 1)
+        side *= 2;
+    cells_per_tiling = (size_t)side * side;
+    weights.assign(this->num_tilings * cells_per_tiling, 0.0f);
+}
+
+/**
+ * @brief Getter to get the number of tilings
+ * @return Number of tilings
+ */
+int TiledCMAC2D::getNumTilings() const
+{
+    return num_tilings;
+}
+
+/**
+ * @brief Getter to get the number of cells across the input range
+ * @return Resolution
+ */
+int TiledCMAC2D::getResolution() const
+{
+    return resolution;
+}
+
+/**
+ * @brief Getter to get the cell layout
+ * @return Layout
+ */
+CellLayout TiledCMAC2D::getLayout() const
+{
+    return layout;
+}
+
+/**
+ * @brief Getter to get the weights, num_tilings blocks of side * side cells
+ * @return Weights
+ */
+const WeightVector& TiledCMAC2D::getWeights() const
+{
+    return weights;
+}
+
+/**
+ * @brief Position of a cell in the weight vector
+ *
+ * @param tiling Tiling index
+ * @param ix Column of the cell in the tiling
+ * @param iy Row of the cell in the tiling
+ * @return Weight index
+ */
+size_t TiledCMAC2D::cellIndex(int tiling, uint32_t ix, uint32_t iy) const
+{
+    size_t offset = layout == LAYOUT_MORTON ? mortonEncode(ix, iy) : (size_t)iy * side + ix;
+    return tiling * cells_per_tiling + offset;
+}
+
+/**
+ * @brief Cells activated by an input, one per tiling
+ *
+ * @param x First input value
+ * @param y Second input value
+ * @param cells Receives num_tilings weight indices
+ */
+void TiledCMAC2D::getActiveCells(float x, float y, size_t* cells) const
+{
+    float scale = resolution / (upperlimit - lowerlimit);
+    float fx = std::min(std::max((x - lowerlimit) * scale, 0.0f), (float)resolution);
+    float fy = std::min(std::max((y - lowerlimit) * scale, 0.0f), (float)resolution);
+    for (int t = 0; t < num_tilings; t++)
+    {
+        // Asymmetric (1, 3) displacement, so the tilings do not all shift along the diagonal
+        float shift_x = (float)t / num_tilings;
+        float shift_y = (float)((3 * t) % num_tilings) / num_tilings;
+        cells[t] = cellIndex(t, (uint32_t)(fx + shift_x), (uint32_t)(fy + shift_y));
+    }
+}
+
+/**
+ * @brief Predict the output for an input
+ *
+ * @param x First input value
+ * @param y Second input value
+ * @return Predicted output value
+ */
+float TiledCMAC2D::predict(float x, float y) const
+{
+    size_t cells[max_tilings];
+    getActiveCells(x, y, cells);
+    float res = 0;
+    for (int t = 0; t < num_tilings; t++)
+        res += weights[cells[t]];
+    return res;
+}
+
+/**
+ * @brief Online update for one sample, the error is distributed uniformly over the active cells
+ *
+ * @param x First input value
+ * @param y Second input value
+ * @param target Output value
+ * @param lr Learning Rate for training
+ */
+void TiledCMAC2D::learn(float x, float y, float target, float lr)
+{
+    size_t cells[max_tilings];
+    getActiveCells(x, y, cells);
+    float res = 0;
+    for (int t = 0; t < num_tilings; t++)
+        res += weights[cells[t]];
+    float correction = (lr * (target - res)) / num_tilings;
+    for (int t = 0; t < num_tilings; t++)
+        weights[cells[t]] += correction;
+}
@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * Optional timeline tracing of training phases.
+ * Build with -DCMAC_TRACE to record CMAC_TRACE_SCOPE spans into per thread buffers and
+ * dump them with writeChromeTrace() as Chrome Trace Event JSON (chrome://tracing, Perfetto).
+ * Without the flag the spans compile to nothing and writeChromeTrace() returns false.
+ */
+
+#include <string>
+
+#ifdef CMAC_TRACE
+
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief One completed span
+ */
+struct TraceEvent
+{
+    const char* name;       // Static string literal
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+/**
+ * @brief Events recorded by one thread (appended without locking)
+ */
+struct TraceBuffer
+{
+    uint32_t tid;
+    std::vector<TraceEvent> events;
+};
+
+/**
+ * @brief Trace Registry Class
+ * Owns every per thread buffer so spans survive their thread, and writes the timeline.
+ */
+class TraceRegistry
+{
+private:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    std::chrono::steady_clock::time_point origin;
+
+public:
+    TraceRegistry();
+    static TraceRegistry& instance();
+    TraceBuffer& local();
+    int64_t now() const;
+    bool writeChromeTrace(const std::string& path);
+};
+
+/**
+ * @brief RAII span recording its lifetime into the calling thread's buffer
+ */
+class TraceSpan
+{
+private:
+    const char* name;
+    int64_t start_ns;
+
+public:
+    TraceSpan(const char* name);
+    ~TraceSpan();
+};
+
+#define CMAC_TRACE_CONCAT_(a, b) a##b
+#define CMAC_TRACE_CONCAT(a, b) CMAC_TRACE_CONCAT_(a, b)
+#define CMAC_TRACE_SCOPE(name) TraceSpan CMAC_TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the TraceRegistry class, timestamps are relative to its creation
+ */
+TraceRegistry::TraceRegistry() : origin(std::chrono::steady_clock::now()) {};
+
+/**
+ * @brief Process wide registry
+ * @return Registry
+ */
+TraceRegistry& TraceRegistry::instance()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+/**
+ * @brief Buffer of the calling thread, registered on first use
+ * @return Thread local buffer
+ */
+TraceBuffer& TraceRegistry::local()
+{
+    thread_local std::shared_ptr<TraceBuffer> buffer;
+    if (!buffer)
+    {
+        buffer = std::make_shared<TraceBuffer>();
+        buffer->events.reserve(4096);
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->tid = (uint32_t)buffers.size() + 1;
+        buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+/**
+ * @brief Nanoseconds since the registry was created
+ * @return Timestamp
+ */
+int64_t TraceRegistry::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+/**
+ * @brief Write every recorded span as Chrome Trace Event JSON
+ * Call once the traced threads are idle (e.g. after training or after the sweep pool drained).
+ *
+ * @param path Output file path
+ * @return True if the file was written
+ */
+bool TraceRegistry::writeChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Timestamps are microseconds; fixed notation keeps nanosecond resolution for long runs
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    for (auto& buffer : buffers)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+             << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+        first = false;
+        for (auto& event : buffer->events)
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                 << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
+
+/**
+ * @brief Initialize the TraceSpan class and take the start timestamp
+ * @param name Static span name
+ */
+TraceSpan::TraceSpan(const char* name) : name(name), start_ns(TraceRegistry::instance().now()) {};
+
+/**
+ * @brief Record the completed span
+ */
+TraceSpan::~TraceSpan()
+{
+    TraceRegistry& registry = TraceRegistry::instance();
+    int64_t end_ns = registry.now();
+    registry.local().events.push_back({ name, start_ns, end_ns - start_ns });
+}
+
+/**
+ * @brief Write every recorded span as Chrome Trace Event JSON
+ * @param path Output file path
+ * @return True if the file was written
+ */
+bool writeChromeTrace(const std::string& path)
+{
+    return TraceRegistry::instance().writeChromeTrace(path);
+}
+
+#else
+
+#define CMAC_TRACE_SCOPE(name) ((void)0)
+
+/**
+ * @brief Tracing is compiled out, nothing to write
+ * @return False
+ */
+inline bool writeChromeTrace(const std::string&)
+{
+    return false;
+}
+
+#endif
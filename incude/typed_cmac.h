@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * CMAC with a chosen weight scalar and accumulator scalar (float or double).
+ * The weights are stored as Weight, window sums, errors and corrections are computed in
+ * Accumulator, so TypedCMAC<float, double> keeps the footprint of a float table while summing
+ * very wide windows (large gen_factor) without float rounding in the prediction and the error.
+ * The association (discrete or continous) comes from a shape CMAC, and updates distribute the
+ * error uniformly over the active cells (UPDATE_UNIFORM), as CMAC::learnSample.
+ */
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cmac.h"
+
+/**
+ * @brief Typed CMAC Class
+ * One model of a variant and shape with Weight storage and Accumulator arithmetic.
+ */
+template <typename Weight, typename Accumulator = Weight>
+class TypedCMAC
+{
+private:
+    std::unique_ptr<CMAC> shape;
+    std::vector<Weight> weights;
+    int gen_factor;
+    float lowerlimit;
+    float upperlimit;
+    int epochs_trained;
+    Accumulator curr_loss;
+
+    Accumulator windowSum(int start_index) const;
+
+public:
+    TypedCMAC(const std::string& variant, int gen_factor, int num_weights, float lowerlimit, float upperlimit);
+    const std::vector<Weight>& getWeights() const;
+    int getEpochsTrained() const;
+    Accumulator getLoss() const;
+    void importModel(const CMAC& source);
+    Accumulator predict(float x) const;
+    void learn(std::pair<float, float> data_element, Accumulator lr);
+    Accumulator calculateError(const std::vector<std::pair<float, float>>& data) const;
+    bool train(const std::vector<std::pair<float, float>>& data, int epochs, Accumulator lr, Accumulator convergenceThreshold);
+};
+
+typedef TypedCMAC<float, float> FloatCMAC;              // Same arithmetic as CMAC
+typedef TypedCMAC<float, double> WideAccumulatorCMAC;   // Float weights, double window sums and corrections
+typedef TypedCMAC<double, double> DoubleCMAC;
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Initialize the TypedCMAC class with every weight at 1, like a fresh CMAC
+ *
+ * @param variant "discrete" or "continous"
+ * @param gen_factor Generalization Factor of the model
+ * @param num_weights Number of weights of the model
+ * @param lowerlimit Lowerlimit value for the data samples
+ * @param upperlimit Uperlimit value for the data samples
+ */
+template <typename Weight, typename Accumulator>
+TypedCMAC<Weight, Accumulator>::TypedCMAC(const std::string& variant, int gen_factor, int num_weights, float lowerlimit, float upperlimit) :
+    shape(createShapeCMAC(variant, gen_factor, num_weights)), weights(num_weights, 1), gen_factor(gen_factor), lowerlimit(lowerlimit),
+    upperlimit(upperlimit), epochs_trained(0), curr_loss(0) {};
+
+/**
+ * @brief Sum of the gen_factor weights from a start index, in Accumulator
+ * @param start_index Index of the first weight of the window
+ * @return Window sum
+ */
+template <typename Weight, typename Accumulator>
+Accumulator TypedCMAC<Weight, Accumulator>::windowSum(int start_index) const
+{
+    Accumulator res = 0;
+    for (int i = start_index; i < start_index + gen_factor; i++)
+        res += weights[i];
+    return res;
+}
+
+/**
+ * @brief Getter to get the weight table
+ * @return Weights
+ */
+template <typename Weight, typename Accumulator>
+const std::vector<Weight>& TypedCMAC<Weight, Accumulator>::getWeights() const
+{
+    return weights;
+}
+
+/**
+ * @brief Getter to get the number of epochs run by the last train call
+ * @return Epochs
+ */
+template <typename Weight, typename Accumulator>
+int TypedCMAC<Weight, Accumulator>::getEpochsTrained() const
+{
+    return epochs_trained;
+}
+
+/**
+ * @brief Getter to get the training loss after the last epoch
+ * @return Root mean squared error
+ */
+template <typename Weight, typename Accumulator>
+Accumulator TypedCMAC<Weight, Accumulator>::getLoss() const
+{
+    return curr_loss;
+}
+
+/**
+ * @brief Copy the weights of a trained CMAC of the same shape
+ * @param source CMAC of the model's variant and shape
+ */
+template <typename Weight, typename Accumulator>
+void TypedCMAC<Weight, Accumulator>::importModel(const CMAC& source)
+{
+    source.forEachWeight([&](size_t i, float w) { weights[i] = w; });
+}
+
+/**
+ * @brief Predict a single input value
+ * @param x Input value
+ * @return Predicted output value
+ */
+template <typename Weight, typename Accumulator>
+Accumulator TypedCMAC<Weight, Accumulator>::predict(float x) const
+{
+    Accumulator res = 0;
+    shape->forEachActiveWindow(x, lowerlimit, upperlimit, [&](int start, float share) { res += windowSum(start) * share; });
+    return res;
+}
+
+/**
+ * @brief Online update for one sample (uniform update, as CMAC::learnSample)
+ *
+ * @param data_element Pair of the input and output data value
+ * @param lr Learning Rate for training
+ */
+template <typename Weight, typename Accumulator>
+void TypedCMAC<Weight, Accumulator>::learn(std::pair<float, float> data_element, Accumulator lr)
+{
+    Accumulator error = data_element.second - predict(data_element.first);
+    Accumulator correction = (lr * error) / gen_factor;
+    shape->forEachActiveCell(data_element.first, lowerlimit, upperlimit, [&](int c, float) { weights[c] = weights[c] + correction; });
+}
+
+/**
+ * @brief Root mean squared error over a dataset, accumulated in Accumulator
+ * @param data Continer of the input and output data values
+ * @return Root mean squared error
+ */
+template <typename Weight, typename Accumulator>
+Accumulator TypedCMAC<Weight, Accumulator>::calculateError(const std::vector<std::pair<float, float>>& data) const
+{
+    Accumulator sum = 0;
+    for (auto& data_element : data)
+    {
+        Accumulator error = data_element.second - predict(data_element.first);
+        sum += error * error;
+    }
+    return data.empty() ? 0 : std::sqrt(sum / data.size());
+}
+
+/**
+ * @brief Train over the data in order until the loss settles or the epoch budget runs out
+ *
+ * @param data Continer of the input and output train data
+ * @param epochs Maximum number of epochs
+ * @param lr Learning Rate for training
+ * @param convergenceThreshold Change of the loss between epochs below which training stops
+ * @return True if training converged
+ */
+template <typename Weight, typename Accumulator>
+bool TypedCMAC<Weight, Accumulator>::train(const std::vector<std::pair<float, float>>& data, int epochs, Accumulator lr, Accumulator convergenceThreshold)
+{
+    Accumulator prev_loss = 0;
+    for (epochs_trained = 0; epochs_trained < epochs;)
+    {
+        for (auto& data_element : data)
+            learn(data_element, lr);
+        epochs_trained++;
+
+        curr_loss = calculateError(data);
+        if (epochs_trained > 1 && std::abs(prev_loss - curr_loss) < convergenceThreshold)
+            return true;
+        prev_loss = curr_loss;
+    }
+    return false;
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <cstring>
+#include "cmac.h"
+#include "model_bank.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Seconds elapsed since a start time
+ * @param start Start time
+ * @return Seconds
+ */
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Target of model m, a scaled x*sin(x) so that every model learns something different
+ *
+ * @param m Model index
+ * @param num_models Number of models
+ * @param x Input value
+ * @return Target output
+ */
+float bankTarget(int m, int num_models, float x)
+{
+    return (0.5f + (float)m / num_models) * x * sin(x);
+}
+
+/**
+ * @brief Model bank benchmark entry point
+ * Trains and queries num_models separate CMAC objects and one ModelBank holding the same models,
+ * checks that both end with identical weights and predictions, and reports the time per model update and query.
+ * Usage: bank_benchmark [--variant discrete|continous] [--models N] [--gf N] [--weights N] [--steps N] [--queries N]
+ */
+int main(int argc, char** argv)
+{
+    std::string variant = "discrete";
+    int num_models = 1024;
+    int gen_factor = 8;
+    int num_weights = 256;
+    int steps = 2000;
+    int queries = 2000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--variant") && i + 1 < argc)
+            variant = argv[++i];
+        else if (!strcmp(argv[i], "--models") && i + 1 < argc)
+            num_models = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--weights") && i + 1 < argc)
+            num_weights = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--steps") && i + 1 < argc)
+            steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queries") && i + 1 < argc)
+            queries = atoi(argv[++i]);
+    }
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+    float lr = 0.05;
+
+    std::vector<std::unique_ptr<CMAC>> models;
+    for (int m = 0; m < num_models; m++)
+        models.push_back(createCMAC(variant, gen_factor, num_weights));
+    ModelBank bank(variant, num_models, gen_factor, num_weights, lowerlimit, upperlimit);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uniform(lowerlimit, upperlimit);
+    std::vector<float> inputs(std::max(steps, queries));
+    for (float& x : inputs)
+        x = uniform(rng);
+    std::vector<float> targets(num_models);
+
+    // Online training, one sample per step for every model
+    auto start = Clock::now();
+    for (int s = 0; s < steps; s++)
+        for (int m = 0; m < num_models; m++)
+            models[m]->learnSample({ inputs[s], bankTarget(m, num_models, inputs[s]) }, lowerlimit, upperlimit, lr);
+    double separate_learn = secondsSince(start);
+
+    start = Clock::now();
+    for (int s = 0; s < steps; s++)
+    {
+        for (int m = 0; m < num_models; m++)
+            targets[m] = bankTarget(m, num_models, inputs[s]);
+        bank.learnAll(inputs[s], targets.data(), lr);
+    }
+    double bank_learn = secondsSince(start);
+
+    // Queries of every model for one input
+    std::vector<float> separate_out(num_models), bank_out(num_models), single_out(num_models);
+    volatile float sink = 0;
+    start = Clock::now();
+    for (int q = 0; q < queries; q++)
+    {
+        for (int m = 0; m < num_models; m++)
+            separate_out[m] = models[m]->predictPoint(inputs[q], lowerlimit, upperlimit);
+        sink = sink + separate_out[q % num_models];
+    }
+    double separate_predict = secondsSince(start);
+
+    start = Clock::now();
+    for (int q = 0; q < queries; q++)
+    {
+        bank.predictAll(inputs[q], bank_out.data());
+        sink = sink + bank_out[q % num_models];
+    }
+    double bank_predict = secondsSince(start);
+
+    start = Clock::now();
+    for (int q = 0; q < queries; q++)
+    {
+        for (int m = 0; m < num_models; m++)
+            single_out[m] = bank.predict(m, inputs[q]);
+        sink = sink + single_out[q % num_models];
+    }
+    double single_predict = secondsSince(start);
+    (void)sink;
+
+    // The bank must hold exactly the weights the separate models learned
+    uint64_t mismatches = 0;
+    std::vector<float> exported;
+    for (int m = 0; m < num_models; m++)
+    {
+        bank.exportModel(m, exported);
+        if (!std::equal(exported.begin(), exported.end(), models[m]->getWtVector().begin(), models[m]->getWtVector().end()) || bank_out[m] != separate_out[m] || single_out[m] != separate_out[m])
+            mismatches++;
+    }
+
+    size_t object_bytes = variant == "discrete" ? sizeof(DiscreteCMAC) : sizeof(ContinousCMAC);
+    size_t separate_bytes = num_models * (object_bytes + models[0]->getWtVector().capacity() * sizeof(float));
+    double per_update = 1e9 / ((double)steps * num_models);
+    double per_query = 1e9 / ((double)queries * num_models);
+    std::cout << num_models << " " << variant << " models, gf " << gen_factor << ", " << num_weights << " weights" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(28) << "" << std::right << std::setw(12) << "update ns" << std::setw(12) << "query ns" << std::setw(14) << "bytes" << std::endl;
+    std::cout << std::left << std::setw(28) << "separate CMAC objects" << std::right << std::setw(12) << separate_learn * per_update << std::setw(12)
+              << separate_predict * per_query << std::setw(14) << separate_bytes << std::endl;
+    std::cout << std::left << std::setw(28) << "bank, all models per input" << std::right << std::setw(12) << bank_learn * per_update << std::setw(12)
+              << bank_predict * per_query << std::setw(14) << bank.getArenaBytes() << std::endl;
+    std::cout << std::left << std::setw(28) << "bank, one model per call" << std::right << std::setw(12) << "" << std::setw(12) << single_predict * per_query << std::endl;
+    std::cout << mismatches << " models differ between the bank and the separate objects" << std::endl;
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <cstring>
+#include "cmac.h"
+
+/**
+ * @brief Global settings shared by every benchmark configuration
+ */
+struct BenchmarkSettings
+{
+    int warmup = 1;
+    int repetitions = 5;
+    int epochs = 2000;
+    float lr = 0.01;
+    float convergenceThreshold = 0.00000000001;
+    int query_rounds = 200;
+    float target_loss = 0.2;
+};
+
+/**
+ * @brief One point of the benchmark grid
+ */
+struct BenchmarkConfig
+{
+    std::string variant;
+    int gen_factor;
+    int num_weights;
+    int points;
+    int threads;
+    UpdateMode mode;
+};
+
+/**
+ * @brief Measurements for one point of the benchmark grid (medians over repetitions)
+ */
+struct BenchmarkResult
+{
+    BenchmarkConfig config;
+    double train_ms;
+    double train_samples_per_sec;
+    double epochs_to_convergence;
+    double epochs_to_target;
+    bool reached_target;            // False if the median repetition never reached the target loss
+    double speedup_vs_uniform;      // Uniform epochs to target / epochs to target, only valid if both reached it
+    double predict_ns_per_query;
+    double predict_queries_per_sec;
+    float test_accuracy;
+};
+
+/**
+ * @brief Generate the shuffled x*sin(x) dataset used by main.cpp
+ *
+ * @param points Number of samples between 0 and 2pi
+ * @return Shuffled dataset
+ */
+std::vector<std::pair<float, float>> generateData(int points)
+{
+    std::vector<std::pair<float, float>> data;
+    float increment = 2 * PI / points;
+    for (int i = 0; i < points; i++)
+        data.push_back({ i * increment, (i * increment) * sin(i * increment) });
+
+    unsigned seed = 0;
+    shuffle(data.begin(), data.end(), std::default_random_engine(seed));
+    return data;
+}
+
+/**
+ * @brief Name of an update mode as written to the JSON output
+ * @param mode Update mode
+ * @return Mode name
+ */
+const char* updateModeName(UpdateMode mode)
+{
+    switch (mode)
+    {
+    case UPDATE_CREDIT: return "credit";
+    case UPDATE_ADAGRAD: return "adagrad";
+    case UPDATE_RMSPROP: return "rmsprop";
+    default: return "uniform";
+    }
+}
+
+/**
+ * @brief Median of a container of samples
+ * @param samples Measured values
+ * @return Median value
+ */
+double median(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    return n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+}
+
+/**
+ * @brief Run warm-up and timed repetitions of training and single point prediction for one configuration
+ *
+ * @param config Grid point
+ * @param settings Global benchmark settings
+ * @return Median measurements
+ */
+BenchmarkResult runBenchmark(const BenchmarkConfig& config, const BenchmarkSettings& settings)
+{
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+    std::vector<std::pair<float, float>> data = generateData(config.points);
+    size_t split = data.size() * 7 / 10;
+    std::vector<std::pair<float, float>> train(data.begin(), data.begin() + split);
+    std::vector<std::pair<float, float>> test(data.begin() + split, data.end());
+
+    std::vector<double> train_ms, samples_per_sec, epochs, target_epochs;
+    std::vector<double> ns_per_query, queries_per_sec;
+    float test_accuracy = 0;
+
+    for (int rep = 0; rep < settings.warmup + settings.repetitions; rep++)
+    {
+        // Training throughput: one independent model per thread, all on the same dataset
+        std::vector<std::unique_ptr<CMAC>> models;
+        int first_target_epoch = settings.epochs + 1;
+        for (int t = 0; t < config.threads; t++)
+        {
+            models.push_back(createCMAC(config.variant, config.gen_factor, config.num_weights));
+            models[t]->setUpdateMode(config.mode);
+        }
+        models[0]->setEpochCallback([&](int epoch, float loss) {
+            if (loss <= settings.target_loss && epoch < first_target_epoch)
+                first_target_epoch = epoch;
+            return true;
+        });
+
+        auto t_start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < config.threads; t++)
+            workers.emplace_back([&, t]() { models[t]->train(train, lowerlimit, upperlimit, settings.epochs, settings.lr, settings.convergenceThreshold); });
+        for (auto& worker : workers)
+            worker.join();
+        auto t_end = std::chrono::steady_clock::now();
+
+        double elapsed_ms = std::chrono::duration<double, std::milli>(t_end - t_start).count();
+        double samples = 0;
+        for (auto& model : models)
+            samples += (double)model->getEpochsTrained() * train.size();
+
+        // Inference latency: every thread queries the same trained model
+        const CMAC& model = *models[0];
+        std::vector<float> sink(config.threads, 0);
+        workers.clear();
+        auto q_start = std::chrono::steady_clock::now();
+        for (int t = 0; t < config.threads; t++)
+            workers.emplace_back([&, t]() {
+                float acc = 0;
+                for (int r = 0; r < settings.query_rounds; r++)
+                    for (size_t i = 0; i < test.size(); i++)
+                        acc += model.predictPoint(test[i].first, lowerlimit, upperlimit);
+                sink[t] = acc;
+            });
+        for (auto& worker : workers)
+            worker.join();
+        auto q_end = std::chrono::steady_clock::now();
+
+        double elapsed_ns = std::chrono::duration<double, std::nano>(q_end - q_start).count();
+        double queries_per_thread = (double)settings.query_rounds * test.size();
+
+        if (rep < settings.warmup)
+            continue;
+
+        train_ms.push_back(elapsed_ms);
+        samples_per_sec.push_back(samples / (elapsed_ms / 1000.0));
+        epochs.push_back(models[0]->getEpochsTrained());
+        target_epochs.push_back(first_target_epoch);
+        ns_per_query.push_back(elapsed_ns / queries_per_thread);
+        queries_per_sec.push_back(queries_per_thread * config.threads / (elapsed_ns / 1e9));
+        models[0]->predict(test, lowerlimit, upperlimit, test_accuracy, false);
+    }
+
+    // Repetitions that never reach the target count as settings.epochs + 1, so they sort last
+    double epochs_to_target = median(target_epochs);
+    bool reached_target = epochs_to_target <= settings.epochs;
+    return { config, median(train_ms), median(samples_per_sec), median(epochs), epochs_to_target, reached_target, 1,
+             median(ns_per_query), median(queries_per_sec), test_accuracy };
+}
+
+/**
+ * @brief Index of the uniform update run of the same configuration (the uniform run precedes the other modes)
+ *
+ * @param results Measurements for every grid point
+ * @param i Index of a result
+ * @return Index of its uniform run
+ */
+size_t uniformIndex(const std::vector<BenchmarkResult>& results, size_t i)
+{
+    while (i > 0 && results[i].config.mode != UPDATE_UNIFORM)
+        i--;
+    return i;
+}
+
+/**
+ * @brief Write a measurement, or null if it was not measured
+ *
+ * @param out Output stream
+ * @param value Measured value
+ * @param valid False to write null
+ */
+void writeOptional(std::ostream& out, double value, bool valid)
+{
+    if (valid)
+        out << value;
+    else
+        out << "null";
+}
+
+/**
+ * @brief Write benchmark results as JSON with a stable key order so runs can be diffed
+ *
+ * @param out Output stream
+ * @param settings Global benchmark settings
+ * @param results Measurements for every grid point
+ */
+void writeJson(std::ostream& out, const BenchmarkSettings& settings, const std::vector<BenchmarkResult>& results)
+{
+    out << "{\n";
+    out << "  \"settings\": { \"warmup\": " << settings.warmup << ", \"repetitions\": " << settings.repetitions
+        << ", \"epochs\": " << settings.epochs << ", \"lr\": " << settings.lr
+        << ", \"convergence_threshold\": " << settings.convergenceThreshold << ", \"query_rounds\": " << settings.query_rounds
+        << ", \"target_loss\": " << settings.target_loss << " },\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& r = results[i];
+        out << "    { \"variant\": \"" << r.config.variant << "\", \"gen_factor\": " << r.config.gen_factor
+            << ", \"num_weights\": " << r.config.num_weights << ", \"points\": " << r.config.points
+            << ", \"threads\": " << r.config.threads << ", \"update\": \"" << updateModeName(r.config.mode) << "\""
+            << ", \"train_ms\": " << r.train_ms << ", \"train_samples_per_sec\": " << r.train_samples_per_sec
+            << ", \"epochs_to_convergence\": " << r.epochs_to_convergence << ", \"epochs_to_target\": ";
+        writeOptional(out, r.epochs_to_target, r.reached_target);
+        out << ", \"reached_target\": " << (r.reached_target ? "true" : "false")
+            << ", \"speedup_vs_uniform\": ";
+        writeOptional(out, r.speedup_vs_uniform, r.reached_target && results[uniformIndex(results, i)].reached_target);
+        out            << ", \"predict_ns_per_query\": " << r.predict_ns_per_query << ", \"predict_queries_per_sec\": " << r.predict_queries_per_sec
+            << ", \"test_accuracy\": " << r.test_accuracy << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+/**
+ * @brief Benchmark entry point
+ * Usage: benchmark [--quick] [--warmup N] [--reps N] [--epochs N] [--lr LR] [--target LOSS] [--out results.json]
+ */
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    std::string out_path;
+    bool quick = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--quick"))
+            quick = true;
+        else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+            settings.warmup = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--reps") && i + 1 < argc)
+            settings.repetitions = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--epochs") && i + 1 < argc)
+            settings.epochs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--lr") && i + 1 < argc)
+            settings.lr = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--target") && i + 1 < argc)
+            settings.target_loss = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc)
+            out_path = argv[++i];
+    }
+    if (settings.repetitions < 1)
+    {
+        std::cerr << "--reps must be at least 1" << std::endl;
+        return 1;
+    }
+
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> variants = { "discrete", "continous" };
+    std::vector<int> gen_factors = quick ? std::vector<int>{ 2 } : std::vector<int>{ 2, 4, 8, 16 };
+    std::vector<int> num_weights = quick ? std::vector<int>{ 35 } : std::vector<int>{ 35, 128, 1024 };
+    std::vector<int> points = quick ? std::vector<int>{ 100 } : std::vector<int>{ 100, 1000, 10000 };
+    std::vector<UpdateMode> modes = { UPDATE_UNIFORM, UPDATE_CREDIT, UPDATE_ADAGRAD, UPDATE_RMSPROP };
+    std::vector<int> threads = { 1 };
+    if (max_threads > 1)
+        threads.push_back(max_threads);
+
+    std::vector<BenchmarkResult> results;
+    for (auto& variant : variants)
+        for (int gf : gen_factors)
+            for (int nw : num_weights)
+            {
+                // Need at least three association cells for the proportionate hash
+                if (nw + 1 - gf < 3)
+                    continue;
+                for (int n : points)
+                    for (int t : threads)
+                    {
+                        // Uniform runs first, the other modes report their speedup against it
+                        size_t uniform = results.size();
+                        for (UpdateMode mode : modes)
+                        {
+                            BenchmarkConfig config = { variant, gf, nw, n, t, mode };
+                            results.push_back(runBenchmark(config, settings));
+                            BenchmarkResult& r = results.back();
+                            // A run that stalls stops changing early, so only epochs to the target loss measure speed
+                            r.speedup_vs_uniform = results[uniform].epochs_to_target / r.epochs_to_target;
+                            std::cerr << variant << " gf=" << gf << " nw=" << nw << " points=" << n << " threads=" << t << " update=" << updateModeName(mode)
+                                      << " samples/s=" << r.train_samples_per_sec << " ns/query=" << r.predict_ns_per_query << " epochs=" << r.epochs_to_convergence;
+                            if (r.reached_target && results[uniform].reached_target)
+                                std::cerr << " epochs_to_target=" << r.epochs_to_target << " speedup=" << r.speedup_vs_uniform << '\n';
+                            else
+                                std::cerr << " epochs_to_target=" << (r.reached_target ? std::to_string((int)r.epochs_to_target) : "unreached") << " speedup=unreached\n";
+                        }
+                    }
+            }
+
+    if (out_path.empty())
+        writeJson(std::cout, settings, results);
+    else
+    {
+        std::ofstream out(out_path);
+        writeJson(out, settings, results);
+    }
+}
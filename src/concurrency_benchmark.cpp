@@ -0,0 +1,260 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <iomanip>
+#include <cstring>
+#include "cmac.h"
+#include "seqlock.h"
+#include "snapshot.h"
+#include "histogram.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Outcome of the seqlock stress run
+ */
+struct StressResult
+{
+    uint64_t writes;
+    uint64_t reads;
+    uint64_t retries;
+    uint64_t torn_windows;      // Windows with mixed values despite the seqlock (must be 0)
+    uint64_t control_torn;      // Windows with mixed values when read weight by weight (shows the race is exercised)
+};
+
+/**
+ * @brief Reader latency and writer throughput of one concurrency scheme
+ */
+struct SchemeResult
+{
+    std::string scheme;
+    LatencyHistogram latency;
+    uint64_t writer_samples;
+    uint64_t retries;
+};
+
+/**
+ * @brief Hammer one seqlock table with whole-window writes and check every read window
+ * The table is split into non-overlapping windows of gf + 1 weights. The writer fills a random window
+ * with one value per write, so a consistent read must see a single value across the window.
+ *
+ * @param gen_factor Generalization Factor (window size - 1)
+ * @param num_weights Table size
+ * @param readers Reader threads
+ * @param seconds Duration
+ * @return Counts of reads, retries and torn windows
+ */
+StressResult runStress(int gen_factor, int num_weights, int readers, double seconds)
+{
+    SeqlockWeights table(std::vector<float>(num_weights, 0));
+    int window = gen_factor + 1;
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> reads(0), retries(0), torn(0), control_torn(0);
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++)
+        threads.emplace_back([&, r]() {
+            std::vector<float> values(window);
+            uint64_t local_reads = 0, local_retries = 0, local_torn = 0, local_control = 0;
+            uint64_t state = r + 1;
+            while (!done.load(std::memory_order_relaxed))
+            {
+                state = splitmix64(state);
+                int first = (int)(state % (num_weights / window)) * window;
+                local_retries += table.read(first, values.data(), window);
+                for (int i = 1; i < window; i++)
+                    if (values[i] != values[0])
+                    {
+                        local_torn++;
+                        break;
+                    }
+
+                // Control: each weight is consistent on its own, the window as a whole is not
+                for (int i = 0; i < window; i++)
+                    table.read(first + i, &values[i], 1);
+                for (int i = 1; i < window; i++)
+                    if (values[i] != values[0])
+                    {
+                        local_control++;
+                        break;
+                    }
+                local_reads++;
+            }
+            reads += local_reads;
+            retries += local_retries;
+            torn += local_torn;
+            control_torn += local_control;
+        });
+
+    // Writer: hot windows so readers and writer collide often
+    std::vector<float> values(window);
+    uint64_t writes = 0;
+    uint64_t state = 0;
+    auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    while (Clock::now() < end)
+        for (int k = 0; k < 1024; k++)
+        {
+            state = splitmix64(state);
+            int first = (int)(state % (num_weights / window)) * window;
+            // Tags wrap below 2^24, where every integer is exact in a float, so consecutive writes always differ
+            std::fill(values.begin(), values.end(), (float)(++writes & 0xffffff));
+            table.write(first, values.data(), window);
+        }
+    done = true;
+    for (auto& thread : threads)
+        thread.join();
+    return { writes, reads.load(), retries.load(), torn.load(), control_torn.load() };
+}
+
+/**
+ * @brief Measure reader latency while a writer learns online, through the seqlock or through snapshots
+ *
+ * @param scheme "seqlock" or "snapshot"
+ * @param data Online training stream (cycled)
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param num_weights Number of weights allowed
+ * @param readers Reader threads
+ * @param seconds Duration
+ * @param publish_every Samples between snapshot publications
+ * @return Merged reader latency and writer throughput
+ */
+SchemeResult runScheme(const std::string& scheme, const std::vector<std::pair<float, float>>& data, int gen_factor, int num_weights, int readers, double seconds, int publish_every)
+{
+    float lowerlimit = 0, upperlimit = 2 * PI;
+    DiscreteCMAC model(gen_factor, num_weights);
+    SeqlockModel seqlock_model(model, lowerlimit, upperlimit);
+    SnapshotPublisher publisher;
+    publisher.publish(model);
+    bool use_seqlock = scheme == "seqlock";
+
+    std::atomic<bool> done(false);
+    std::vector<LatencyHistogram> latencies(readers);
+    std::vector<uint64_t> retries(readers, 0);
+    std::vector<float> sinks(readers, 0);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++)
+        threads.emplace_back([&, r]() {
+            int reader = publisher.registerReader();
+            uint64_t state = r + 1;
+            float sink = 0;
+            while (!done.load(std::memory_order_relaxed))
+            {
+                state = splitmix64(state);
+                float x = (state >> 40) * (upperlimit / (1 << 24));
+                auto t0 = Clock::now();
+                if (use_seqlock)
+                    sink += seqlock_model.predict(x, &retries[r]);
+                else
+                {
+                    SnapshotGuard guard(publisher, reader);
+                    sink += guard.get()->predict(x, lowerlimit, upperlimit);
+                }
+                auto t1 = Clock::now();
+                latencies[r].record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            }
+            publisher.unregisterReader(reader);
+            sinks[r] = sink;
+        });
+
+    uint64_t samples = 0;
+    auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    while (Clock::now() < end)
+        for (int k = 0; k < 1024; k++, samples++)
+        {
+            const std::pair<float, float>& sample = data[samples % data.size()];
+            if (use_seqlock)
+                seqlock_model.learn(sample, 0.1);
+            else
+            {
+                model.learnSample(sample, lowerlimit, upperlimit, 0.1);
+                if ((samples + 1) % publish_every == 0)
+                    publisher.publish(model);
+            }
+        }
+    done = true;
+    for (auto& thread : threads)
+        thread.join();
+
+    SchemeResult result = { scheme, LatencyHistogram(), samples, 0 };
+    for (int r = 0; r < readers; r++)
+    {
+        result.latency.merge(latencies[r]);
+        result.retries += retries[r];
+    }
+    return result;
+}
+
+/**
+ * @brief Concurrency benchmark entry point
+ * Verifies that seqlock readers never observe a partially written window, then compares reader
+ * latency of the seqlock table against published snapshots while a writer learns online.
+ * Usage: concurrency_benchmark [--seconds S] [--readers N] [--gf N] [--weights N] [--publish-every N]
+ */
+int main(int argc, char** argv)
+{
+    double seconds = 2;
+    int readers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    int gen_factor = 8;
+    int num_weights = 256;
+    int publish_every = 64;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--readers") && i + 1 < argc)
+            readers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--weights") && i + 1 < argc)
+            num_weights = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--publish-every") && i + 1 < argc)
+            publish_every = std::max(1, atoi(argv[++i]));
+    }
+    readers = std::min(readers, SnapshotPublisher::max_readers);
+
+    StressResult stress = runStress(gen_factor, num_weights, readers, seconds);
+    std::cout << "Seqlock stress: " << stress.writes << " writes, " << stress.reads << " window reads, " << stress.retries << " retries, "
+              << stress.torn_windows << " torn windows (control without seqlock: " << stress.control_torn << ")" << std::endl;
+    bool passed = stress.torn_windows == 0;
+    std::cout << (passed ? "PASS" : "FAIL") << ": readers never saw a partially updated window" << std::endl << std::endl;
+
+    std::vector<std::pair<float, float>> data;
+    for (int i = 0; i < 4096; i++)
+    {
+        float x = (splitmix64(i) >> 40) * (2 * PI / (1 << 24));
+        data.push_back({ x, x * sin(x) });
+    }
+
+    std::cout << std::left << std::setw(10) << "scheme" << std::right << std::setw(12) << "queries" << std::setw(8) << "p50" << std::setw(8) << "p99"
+              << std::setw(8) << "p999" << std::setw(10) << "max" << std::setw(16) << "writer/s" << std::setw(12) << "retries" << '\n';
+    for (const char* scheme : { "seqlock", "snapshot" })
+    {
+        SchemeResult r = runScheme(scheme, data, gen_factor, num_weights, readers, seconds, publish_every);
+        const LatencyHistogram& l = r.latency;
+        std::cout << std::left << std::setw(10) << r.scheme << std::right << std::setw(12) << l.getCount() << std::setw(8) << l.getPercentile(50)
+                  << std::setw(8) << l.getPercentile(99) << std::setw(8) << l.getPercentile(99.9) << std::setw(10) << l.getMax()
+                  << std::setw(16) << (uint64_t)(r.writer_samples / seconds) << std::setw(12) << r.retries << '\n';
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <iomanip>
+#include <cstring>
+#include <limits>
+#include "cmac.h"
+#include "histogram.h"
+#include "inference_server.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Settings shared by every client thread
+ */
+struct ClientSettings
+{
+    std::string socket_path;
+    int requests;           // Requests per client
+    int points;             // Inputs per request
+    int pipeline;           // Requests in flight per client
+    float lowerlimit;
+    float upperlimit;
+    const CMAC* reference;  // Local copy of the served model to check answers against (may be nullptr)
+};
+
+/**
+ * @brief Results of one client thread
+ */
+struct ClientReport
+{
+    LatencyHistogram latency;
+    uint64_t mismatches = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Send random requests with a bounded number in flight and time each round trip
+ *
+ * @param settings Client settings
+ * @param seed Seed of the query inputs
+ * @param report Report receiving the latencies and mismatches
+ */
+void runClient(const ClientSettings& settings, unsigned seed, ClientReport& report)
+{
+    InferenceClient client;
+    if (!client.connect(settings.socket_path))
+    {
+        report.failed = true;
+        return;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(settings.lowerlimit, settings.upperlimit);
+    std::vector<std::vector<float>> inputs(settings.pipeline, std::vector<float>(settings.points));
+    std::vector<Clock::time_point> sent(settings.pipeline);
+    std::vector<float> out;
+
+    int issued = 0;
+    int answered = 0;
+    while (answered < settings.requests)
+    {
+        while (issued < settings.requests && issued - answered < settings.pipeline)
+        {
+            std::vector<float>& x = inputs[issued % settings.pipeline];
+            for (float& v : x)
+                v = uniform(rng);
+            uint32_t id;
+            sent[issued % settings.pipeline] = Clock::now();
+            if (!client.send(x.data(), (uint32_t)x.size(), id))
+            {
+                report.failed = true;
+                return;
+            }
+            issued++;
+        }
+
+        uint32_t id;
+        if (!client.receive(out, id) || id != (uint32_t)answered || out.size() != (size_t)settings.points)
+        {
+            report.failed = true;
+            return;
+        }
+        report.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent[answered % settings.pipeline]).count());
+        if (settings.reference)
+        {
+            const std::vector<float>& x = inputs[answered % settings.pipeline];
+            for (size_t i = 0; i < x.size(); i++)
+                if (out[i] != settings.reference->predictPoint(x[i], settings.lowerlimit, settings.upperlimit))
+                    report.mismatches++;
+        }
+        answered++;
+    }
+}
+
+/**
+ * @brief Check that the server survives malformed inputs: out of range values are answered as the
+ * nearest limit and a non finite value closes only the connection that sent it
+ *
+ * @param settings Client settings
+ * @return False if the server answered wrongly or stopped serving
+ */
+bool checkMalformedInputs(const ClientSettings& settings)
+{
+    InferenceClient client;
+    std::vector<float> out;
+    uint32_t id, answer_id;
+    float out_of_range[2] = { -3e9f, 3e9f };
+    if (!client.connect(settings.socket_path) || !client.send(out_of_range, 2, id) || !client.receive(out, answer_id) || answer_id != id || out.size() != 2)
+        return false;
+    if (settings.reference && (out[0] != settings.reference->predictPoint(settings.lowerlimit, settings.lowerlimit, settings.upperlimit)
+                               || out[1] != settings.reference->predictPoint(settings.upperlimit, settings.lowerlimit, settings.upperlimit)))
+        return false;
+
+    float not_finite = std::numeric_limits<float>::quiet_NaN();
+    if (client.send(&not_finite, 1, id) && client.receive(out, answer_id))
+        return false;
+
+    // A fresh connection must still be served
+    InferenceClient next;
+    float x = settings.lowerlimit;
+    return next.connect(settings.socket_path) && next.send(&x, 1, id) && next.receive(out, answer_id) && out.size() == 1;
+}
+
+/**
+ * @brief Inference client entry point, a load generator for inference_server
+ * Usage: inference_client [--socket path] [--clients N] [--requests N] [--points N] [--pipeline N] [--model file.bin] [--lower X] [--upper X]
+ * With --model every answer is compared against the same model evaluated locally (exit code 1 on any difference).
+ * The load is preceded by a malformed input check (out of range and NaN inputs).
+ */
+int main(int argc, char** argv)
+{
+    ClientSettings settings = { "cmac_inference.sock", 10000, 1, 1, 0, 2 * PI, nullptr };
+    std::string model_path;
+    int clients = 4;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--socket") && i + 1 < argc)
+            settings.socket_path = argv[++i];
+        else if (!strcmp(argv[i], "--clients") && i + 1 < argc)
+            clients = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--requests") && i + 1 < argc)
+            settings.requests = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--points") && i + 1 < argc)
+            settings.points = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--pipeline") && i + 1 < argc)
+            settings.pipeline = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--model") && i + 1 < argc)
+            model_path = argv[++i];
+        else if (!strcmp(argv[i], "--lower") && i + 1 < argc)
+            settings.lowerlimit = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--upper") && i + 1 < argc)
+            settings.upperlimit = atof(argv[++i]);
+    }
+
+    std::unique_ptr<CMAC> reference;
+    if (!model_path.empty())
+    {
+        reference = loadCMAC(model_path);
+        if (!reference)
+        {
+            std::cerr << "could not load " << model_path << std::endl;
+            return 1;
+        }
+        settings.reference = reference.get();
+    }
+
+    if (!checkMalformedInputs(settings))
+    {
+        std::cerr << "malformed input check failed against " << settings.socket_path << std::endl;
+        return 1;
+    }
+    std::cout << "malformed inputs handled" << std::endl;
+
+    std::vector<ClientReport> reports(clients);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int c = 0; c < clients; c++)
+        threads.emplace_back(runClient, std::cref(settings), (unsigned)c, std::ref(reports[c]));
+    for (auto& thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    LatencyHistogram latency;
+    uint64_t mismatches = 0;
+    bool failed = false;
+    for (const ClientReport& report : reports)
+    {
+        latency.merge(report.latency);
+        mismatches += report.mismatches;
+        failed = failed || report.failed;
+    }
+    if (failed)
+    {
+        std::cerr << "a client lost its connection to " << settings.socket_path << std::endl;
+        return 1;
+    }
+
+    uint64_t requests = (uint64_t)clients * settings.requests;
+    std::cout << clients << " clients x " << settings.requests << " requests of " << settings.points << " points (pipeline " << settings.pipeline << ")" << std::endl;
+    std::cout << std::fixed << std::setprecision(0) << requests / seconds << " requests/s, " << requests * settings.points / seconds << " points/s" << std::endl;
+    std::cout << "round trip ns  p50 " << latency.getPercentile(50) << "  p90 " << latency.getPercentile(90) << "  p99 " << latency.getPercentile(99)
+              << "  max " << latency.getMax() << std::endl;
+    if (settings.reference)
+        std::cout << mismatches << " answers differ from the local model" << std::endl;
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstring>
+#include <csignal>
+#include "cmac.h"
+#include "inference_server.h"
+
+volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * @brief Signal handler asking the event loop to exit
+ */
+void requestStop(int)
+{
+    stop_requested = 1;
+}
+
+/**
+ * @brief Inference server entry point
+ * Usage: inference_server [--model file.bin] [--save file.bin] [--socket path] [--max-batch N] [--max-delay-us N] [--lower X] [--upper X]
+ * Without --model a discrete model is trained on the x*sin(x) data first (and written to --save if given).
+ */
+int main(int argc, char** argv)
+{
+    std::string model_path;
+    std::string save_path;
+    std::string socket_path = "cmac_inference.sock";
+    int max_batch = 256;
+    int max_delay_us = 200;
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--model") && i + 1 < argc)
+            model_path = argv[++i];
+        else if (!strcmp(argv[i], "--save") && i + 1 < argc)
+            save_path = argv[++i];
+        else if (!strcmp(argv[i], "--socket") && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (!strcmp(argv[i], "--max-batch") && i + 1 < argc)
+            max_batch = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-delay-us") && i + 1 < argc)
+            max_delay_us = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--lower") && i + 1 < argc)
+            lowerlimit = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--upper") && i + 1 < argc)
+            upperlimit = atof(argv[++i]);
+    }
+
+    std::unique_ptr<CMAC> model;
+    if (!model_path.empty())
+    {
+        model = loadCMAC(model_path);
+        if (!model)
+        {
+            std::cerr << "could not load " << model_path << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::vector<std::pair<float, float>> data;
+        for (int i = 0; i < 1000; i++)
+        {
+            float x = lowerlimit + i * (upperlimit - lowerlimit) / 1000;
+            data.push_back({ x, x * sin(x) });
+        }
+        model = createCMAC("discrete", 8, 1024);
+        model->setLearningRateSchedule(LearningRateSchedule::automatic());
+        model->train(data, lowerlimit, upperlimit, 200, 0.01, 0.00000000001);
+        if (!save_path.empty() && !model->saveModel(save_path))
+            std::cerr << "could not save " << save_path << std::endl;
+    }
+
+    InferenceServer server(*model, lowerlimit, upperlimit, socket_path, max_batch, std::chrono::microseconds(max_delay_us));
+    if (!server.start())
+        return 1;
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    signal(SIGPIPE, SIG_IGN);
+    std::cout << "serving " << model->getName() << " on " << socket_path << " (max batch " << max_batch << ", max delay " << max_delay_us << " us)" << std::endl;
+
+    server.run(stop_requested);
+
+    const InferenceServerStats& stats = server.getStats();
+    std::cout << stats.connections << " connections, " << stats.requests << " requests, " << stats.points << " points in " << stats.batches << " batches ("
+              << (stats.batches ? (double)stats.points / stats.batches : 0) << " points per batch, largest " << stats.max_batch_points << ")" << std::endl;
+    return 0;
+}
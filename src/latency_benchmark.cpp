@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <iomanip>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "cmac.h"
+#include "histogram.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Latency and wake-up jitter recorded for one run of the harness
+ */
+struct LatencyReport
+{
+    std::string variant;
+    std::string mode;
+    bool pinned;
+    LatencyHistogram latency;     // Duration of the predictPoint call
+    LatencyHistogram jitter;      // Lateness of the call against its schedule (fixed rate only)
+};
+
+/**
+ * @brief Pin the calling thread to a single core
+ *
+ * @param core Core index
+ * @return True if the affinity could be set on this platform
+ */
+bool pinToCore(int core)
+{
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Cost of one pair of clock reads, subtracted from every latency sample
+ * @return Median clock overhead in ns
+ */
+uint64_t clockOverhead()
+{
+    LatencyHistogram overhead;
+    for (int i = 0; i < 100000; i++)
+    {
+        auto t0 = Clock::now();
+        auto t1 = Clock::now();
+        overhead.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    return overhead.getPercentile(50);
+}
+
+/**
+ * @brief Issue single point queries back to back
+ *
+ * @param model Trained model
+ * @param queries Pre-generated query inputs
+ * @param samples Number of queries to time
+ * @param overhead Clock overhead to subtract
+ * @param report Report receiving the latency samples
+ */
+void runTightLoop(const CMAC& model, const std::vector<float>& queries, int samples, uint64_t overhead, LatencyReport& report)
+{
+    volatile float sink = 0;
+    for (int i = 0; i < samples; i++)
+    {
+        float x = queries[i % queries.size()];
+        auto t0 = Clock::now();
+        sink = model.predictPoint(x, 0, 2 * PI);
+        auto t1 = Clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        report.latency.record(ns > overhead ? ns - overhead : 0);
+    }
+    (void)sink;
+}
+
+/**
+ * @brief Issue single point queries on a fixed period, busy waiting for each deadline like a control loop
+ *
+ * @param model Trained model
+ * @param queries Pre-generated query inputs
+ * @param samples Number of queries to time
+ * @param rate_hz Query rate
+ * @param overhead Clock overhead to subtract
+ * @param report Report receiving the latency and jitter samples
+ */
+void runFixedRate(const CMAC& model, const std::vector<float>& queries, int samples, int rate_hz, uint64_t overhead, LatencyReport& report)
+{
+    volatile float sink = 0;
+    auto period = std::chrono::nanoseconds(1000000000LL / rate_hz);
+    auto deadline = Clock::now() + period;
+
+    for (int i = 0; i < samples; i++)
+    {
+        while (Clock::now() < deadline)
+            ;
+
+        float x = queries[i % queries.size()];
+        auto t0 = Clock::now();
+        sink = model.predictPoint(x, 0, 2 * PI);
+        auto t1 = Clock::now();
+
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        report.latency.record(ns > overhead ? ns - overhead : 0);
+        report.jitter.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t0 - deadline).count());
+        deadline += period;
+    }
+    (void)sink;
+}
+
+/**
+ * @brief Print one report as a table row (all values in ns)
+ * @param report Latency report
+ */
+void printReport(const LatencyReport& report)
+{
+    const LatencyHistogram& l = report.latency;
+    std::cout << std::left << std::setw(10) << report.variant << std::setw(10) << report.mode << std::setw(8) << (report.pinned ? "yes" : "no")
+              << std::right << std::setw(9) << l.getCount() << std::setw(8) << l.getMin() << std::setw(8) << l.getPercentile(50)
+              << std::setw(8) << l.getPercentile(90) << std::setw(8) << l.getPercentile(99) << std::setw(8) << l.getPercentile(99.9)
+              << std::setw(10) << l.getMax();
+    if (report.jitter.getCount())
+        std::cout << std::setw(10) << report.jitter.getPercentile(99) << std::setw(10) << report.jitter.getPercentile(99.9) << std::setw(10) << report.jitter.getMax();
+    std::cout << '\n';
+}
+
+/**
+ * @brief Latency harness entry point
+ * Usage: latency_benchmark [--samples N] [--core N]
+ */
+int main(int argc, char** argv)
+{
+    int samples = 10000;
+    int tight_samples = 1000000;
+    int core = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--samples") && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--core") && i + 1 < argc)
+            core = atoi(argv[++i]);
+    }
+
+    // Same dataset and hyperparameters as main.cpp
+    int points = 100;
+    int gen_factor = 2;
+    int num_weights = 35;
+    std::vector<std::pair<float, float>> data;
+    float increment = 2 * PI / points;
+    for (int i = 0; i < points; i++)
+        data.push_back({ i * increment, (i * increment) * sin(i * increment) });
+
+    DiscreteCMAC discrete_cmac(gen_factor, num_weights);
+    ContinousCMAC continous_cmac(gen_factor, num_weights);
+    discrete_cmac.train(data, 0, 2 * PI, 2000, 0.01, 0.00000000001);
+    continous_cmac.train(data, 0, 2 * PI, 2000, 0.01, 0.00000000001);
+
+    std::vector<float> queries(4096);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uniform(0, 2 * PI);
+    for (auto& q : queries)
+        q = uniform(rng);
+
+    uint64_t overhead = clockOverhead();
+    std::cout << "Clock overhead (subtracted): " << overhead << " ns" << std::endl;
+
+    std::vector<LatencyReport> reports;
+    std::vector<std::pair<std::string, const CMAC*>> models = { { "discrete", &discrete_cmac }, { "continous", &continous_cmac } };
+
+    for (int pinned = 0; pinned <= 1; pinned++)
+    {
+        // Each configuration runs on a fresh thread so unpinned runs keep the default affinity
+        std::thread runner([&]() {
+            if (pinned && !pinToCore(core))
+                std::cerr << "Core pinning is not supported here, pinned rows are unpinned" << std::endl;
+
+            for (auto& model : models)
+            {
+                LatencyReport tight = {};
+                tight.variant = model.first;
+                tight.mode = "tight";
+                tight.pinned = pinned != 0;
+                runTightLoop(*model.second, queries, tight_samples, overhead, tight);
+                reports.push_back(tight);
+
+                for (int rate : { 1000, 10000 })
+                {
+                    LatencyReport fixed = {};
+                    fixed.variant = model.first;
+                    fixed.mode = rate == 1000 ? "1kHz" : "10kHz";
+                    fixed.pinned = pinned != 0;
+                    runFixedRate(*model.second, queries, samples, rate, overhead, fixed);
+                    reports.push_back(fixed);
+                }
+            }
+        });
+        runner.join();
+    }
+
+    std::cout << std::left << std::setw(10) << "variant" << std::setw(10) << "mode" << std::setw(8) << "pinned"
+              << std::right << std::setw(9) << "count" << std::setw(8) << "min" << std::setw(8) << "p50"
+              << std::setw(8) << "p90" << std::setw(8) << "p99" << std::setw(8) << "p999" << std::setw(10) << "max"
+              << std::setw(10) << "jit_p99" << std::setw(10) << "jit_p999" << std::setw(10) << "jit_max" << '\n';
+    for (auto& report : reports)
+        printReport(report);
+}
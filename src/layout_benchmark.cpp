@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include "cmac.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Memory of the process backed by transparent or hugetlbfs huge pages (Linux, else 0)
+ * @return Kilobytes
+ */
+long hugePagesKB()
+{
+    std::ifstream file("/proc/self/smaps_rollup");
+    std::string line;
+    long total = 0;
+    while (std::getline(file, line))
+        if (!line.compare(0, 14, "AnonHugePages:") || !line.compare(0, 16, "Private_Hugetlb:"))
+            total += atol(line.c_str() + line.find(':') + 1);
+    return total;
+}
+
+/**
+ * @brief Print one row of the table: time and (with CMAC_PERF_COUNTERS) misses per operation
+ *
+ * @param mode Huge page mode of the row
+ * @param phase "query" or "update"
+ * @param ns Nanoseconds per operation
+ * @param counts Counters of the phase
+ * @param n Number of operations
+ * @param huge_kb Weights backed by huge pages
+ */
+void printRow(HugePages mode, const char* phase, double ns, const PerfCounts& counts, int n, long huge_kb)
+{
+    std::cout << std::left << std::setw(10) << hugePagesName(mode) << std::setw(8) << phase << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << huge_kb / 1024.0 << std::setw(10) << ns;
+    if (CMAC_PERF_ENABLED)
+        std::cout << std::setprecision(3) << std::setw(12) << (double)counts.l1d_misses / n << std::setw(12) << (double)counts.llc_misses / n
+                  << std::setw(12) << (double)counts.dtlb_misses / n;
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Weight layout benchmark entry point
+ * Queries and trains a table much larger than the LLC and the TLB reach of 4 KB pages at random
+ * inputs, once per huge page mode of the weight vector, and reports time and misses per operation.
+ * Usage: layout_benchmark [--weights N] [--gf N] [--queries N]
+ */
+int main(int argc, char** argv)
+{
+    int num_weights = 1 << 25;
+    int gen_factor = 16;
+    int queries = 2000000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--weights") && i + 1 < argc)
+            num_weights = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queries") && i + 1 < argc)
+            queries = atoi(argv[++i]);
+    }
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uniform(lowerlimit, upperlimit);
+    std::vector<float> inputs(queries);
+    for (float& x : inputs)
+        x = uniform(rng);
+
+    if (!CMAC_PERF_ENABLED)
+        std::cerr << "Built without CMAC_PERF_COUNTERS, misses are not reported" << std::endl;
+
+    std::cout << "Random inputs on " << num_weights << " weights (" << num_weights * sizeof(float) / 1048576 << " MiB), discrete, gf " << gen_factor << std::endl;
+    std::cout << std::left << std::setw(10) << "pages" << std::setw(8) << "op" << std::right << std::setw(12) << "huge MiB" << std::setw(10) << "ns/op";
+    if (CMAC_PERF_ENABLED)
+        std::cout << std::setw(12) << "L1D/op" << std::setw(12) << "LLC/op" << std::setw(12) << "dTLB/op";
+    std::cout << std::endl;
+
+    for (HugePages mode : { HUGE_PAGES_OFF, HUGE_PAGES_ADVISE, HUGE_PAGES_HUGETLB })
+    {
+        PerfCounts counts[PERF_PHASE_COUNT] = {};
+        long huge_kb = hugePagesKB();
+        DiscreteCMAC model(gen_factor, num_weights);
+        model.setHugePages(mode);
+        huge_kb = hugePagesKB() - huge_kb;
+
+        volatile float sink = 0;
+        auto start = Clock::now();
+        {
+            CMAC_PERF_SCOPE(PERF_EVALUATE);
+            for (int q = 0; q < queries; q++)
+                sink = sink + model.predictPoint(inputs[q], lowerlimit, upperlimit);
+        }
+        double query_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queries;
+        (void)sink;
+
+        start = Clock::now();
+        {
+            CMAC_PERF_SCOPE(PERF_UPDATE);
+            for (int q = 0; q < queries; q++)
+                model.learnSample({ inputs[q], inputs[q] * sin(inputs[q]) }, lowerlimit, upperlimit, 0.1);
+        }
+        double update_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queries;
+
+#if CMAC_PERF_ENABLED
+        PerfCounters::local().collect(counts);
+#endif
+        printRow(mode, "query", query_ns, counts[PERF_EVALUATE], queries, huge_kb);
+        printRow(mode, "update", update_ns, counts[PERF_UPDATE], queries, huge_kb);
+    }
+    return 0;
+}
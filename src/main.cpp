@@ -34,15 +34,18 @@ int main()
     int num_weights = 35;
 
     std::vector<std::pair<float, float>> data;
-    data.push_back({ 0, 0 * sin(0) });
-    float increment = 2 * PI / points;
+    unsigned seed = 0;
+    {
+        CMAC_TRACE_SCOPE("load data");
+        data.push_back({ 0, 0 * sin(0) });
+        float increment = 2 * PI / points;
 
-    for (int i = 1; i < points; i++)
-        data.push_back({ i * increment, (i * increment) * sin(i * increment) });
+        for (int i = 1; i < points; i++)
+            data.push_back({ i * increment, (i * increment) * sin(i * increment) });
 
-    // Random shuffling of the data
-    unsigned seed = 0;
-    shuffle(data.begin(), data.end(), std::default_random_engine(seed));
+        // Random shuffling of the data (for the train/test split, epochs reshuffle through an index permutation)
+        shuffle(data.begin(), data.end(), std::default_random_engine(seed));
+    }
 
     // Train data
     std::vector<std::pair<float, float>> train(data.begin(), data.begin() + 70);
@@ -50,6 +53,7 @@ int main()
 
     float lowerlimit = 0;
     float upperlimit = 2 * PI;
+    // Upper bound only, the automatic step size usually converges within a few hundred epochs
     int epochs = 2000;
     float lr = 0.01;
     float convergenceThreshold = 0.00000000001;
@@ -57,15 +61,22 @@ int main()
     std::vector<std::pair<float, float>> predicted_data_dicrete;
     std::vector<std::pair<float, float>> predicted_data_continous;
 
+    // Epoch logs are formatted and printed off the training thread
+    TelemetrySink console_sink(std::make_unique<ConsoleFormatter>());
+
     // discrete cmac
     DiscreteCMAC discrete_cmac(gen_factor, num_weights);
+    discrete_cmac.setTelemetrySink(&console_sink);
+    discrete_cmac.setLearningRateSchedule(LearningRateSchedule::automatic());
+    discrete_cmac.setShuffle(SHUFFLE_EPOCH, seed);
 
     //Training
     auto dt_start = std::chrono::high_resolution_clock::now();
     discrete_cmac.train(train, lowerlimit, upperlimit, epochs, lr, convergenceThreshold);
     auto dt_end = std::chrono::high_resolution_clock::now();
     double elapsed_time_ms_d = std::chrono::duration<double, std::milli>(dt_end - dt_start).count();
-    
+    console_sink.waitUntilDrained();
+
     std::cout << "DiscreteCMAC: " << " Generalization Factor : " << gen_factor << " Convergence Time : " << elapsed_time_ms_d << std::endl;
 
     predicted_data_dicrete = discrete_cmac.predict(test, lowerlimit, upperlimit, accuracy, false);
@@ -77,12 +88,16 @@ int main()
     // continous cmac
     accuracy = 0.0;
     ContinousCMAC continous_cmac(gen_factor, num_weights);
+    continous_cmac.setTelemetrySink(&console_sink);
+    continous_cmac.setLearningRateSchedule(LearningRateSchedule::automatic());
+    continous_cmac.setShuffle(SHUFFLE_EPOCH, seed);
 
     // Training
     auto ct_start = std::chrono::high_resolution_clock::now();
     continous_cmac.train(train, lowerlimit, upperlimit, epochs, lr, convergenceThreshold);
     auto ct_end = std::chrono::high_resolution_clock::now();
     double elapsed_time_ms_c = std::chrono::duration<double, std::milli>(ct_end - ct_start).count();
+    console_sink.waitUntilDrained();
     std::cout << "ContinousCMAC: " << " Generalization Factor: " << gen_factor << " Convergence Time: " << elapsed_time_ms_c << std::endl;
 
 
@@ -90,6 +105,9 @@ int main()
     sort(predicted_data_continous.begin(), predicted_data_continous.end());
 
 
+    // Timeline of the training phases (only recorded when built with CMAC_TRACE)
+    writeChromeTrace("cmac_trace.json");
+
     // sorting the original data for plotting
     sort(data.begin(), data.end());
 
@@ -105,29 +123,6 @@ int main()
     plot(data, predicted_data_continous, 'c');
 
     //----------------------------------------------------------------------
-   
-    //Analysis of Generalization Factors and Convergence times
-
-    //DiscreteCMAC discrete_cmac(gen_factor, num_weights);
-
-    //float time;
-    //std::vector<int> gen_factors;
-    //for (int i = 1; i <= num_weights; i++)
-    //    gen_factors.push_back(i);
-    //
-    //for (auto gf : gen_factors)
-    //{
-    //    accuracy = 1.0;
-    //    discrete_cmac.setGenFactor(gf);
-    //    
-    //    auto t_start = std::chrono::high_resolution_clock::now();
-    //    discrete_cmac.train(train, lowerlimit, upperlimit, epochs, lr, convergenceThreshold);
-    //    auto t_end = std::chrono::high_resolution_clock::now();
-    //    double elapsed_time_ms = std::chrono::duration<double, std::milli>(t_end - t_start).count();
-
-    //    predicted_data_dicrete = discrete_cmac.predict(test, lowerlimit, upperlimit, accuracy, false);
-    //     
-    //    std::cout << "Generalization Factor: " << gf << " Convergence Time(ms): " << elapsed_time_ms << std::endl;
-    //}
-}
 
+    //Analysis of Generalization Factors and Convergence times: see src/sweep.cpp
+}
@@ -0,0 +1,191 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <cstring>
+#include "cmac.h"
+#include "tiled_cmac.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Smooth trajectory through the input plane, like the states of a control loop
+ * A point moving at constant speed whose heading drifts randomly, reflected at the borders.
+ *
+ * @param steps Number of points
+ * @param speed Distance per step, in cells
+ * @param resolution Cells across the input range
+ * @param upperlimit Uperlimit value of both inputs (the lowerlimit is 0)
+ * @param rng Random generator
+ * @return Points
+ */
+std::vector<std::pair<float, float>> smoothTrajectory(int steps, float speed, int resolution, float upperlimit, std::mt19937& rng)
+{
+    std::normal_distribution<float> turn(0, 0.05f);
+    std::vector<std::pair<float, float>> points(steps);
+    float step = speed * upperlimit / resolution;
+    float x = upperlimit / 2, y = upperlimit / 2, heading = 0;
+    for (auto& point : points)
+    {
+        heading += turn(rng);
+        x += step * cos(heading);
+        y += step * sin(heading);
+        if (x < 0 || x >= upperlimit)
+        {
+            heading = PI - heading;
+            x = std::min(std::max(x, 0.0f), upperlimit);
+        }
+        if (y < 0 || y >= upperlimit)
+        {
+            heading = -heading;
+            y = std::min(std::max(y, 0.0f), upperlimit);
+        }
+        point = { x, y };
+    }
+    return points;
+}
+
+/**
+ * @brief Average number of active cells per step that lie on another cache line than the previous step's cell of the same tiling
+ *
+ * @param model Model whose layout is measured
+ * @param points Inputs in visiting order
+ * @return New lines per step
+ */
+double newLinesPerStep(const TiledCMAC2D& model, const std::vector<std::pair<float, float>>& points)
+{
+    const size_t line_floats = cache_line_size / sizeof(float);
+    size_t cells[TiledCMAC2D::max_tilings], previous[TiledCMAC2D::max_tilings];
+    model.getActiveCells(points[0].first, points[0].second, previous);
+    size_t changes = 0;
+    for (size_t i = 1; i < points.size(); i++)
+    {
+        model.getActiveCells(points[i].first, points[i].second, cells);
+        for (int t = 0; t < model.getNumTilings(); t++)
+        {
+            changes += cells[t] / line_floats != previous[t] / line_floats;
+            previous[t] = cells[t];
+        }
+    }
+    return (double)changes / (points.size() - 1);
+}
+
+/**
+ * @brief Time one control step (predict, then learn) per point
+ *
+ * @param model Model to train
+ * @param points Inputs in visiting order
+ * @return Nanoseconds per step
+ */
+double controlStepNs(TiledCMAC2D& model, const std::vector<std::pair<float, float>>& points)
+{
+    volatile float sink = 0;
+    auto start = Clock::now();
+    for (auto& point : points)
+    {
+        sink = sink + model.predict(point.first, point.second);
+        model.learn(point.first, point.second, sin(point.first) * cos(point.second), 0.1);
+    }
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / points.size();
+}
+
+/**
+ * @brief Morton layout benchmark entry point
+ * Checks the pdep / table interleave and that both layouts learn identically, then compares
+ * the cache lines touched and the time per control step of row-major and Morton cell order on a
+ * smooth trajectory and on random inputs.
+ * Usage: morton_benchmark [--tilings N] [--resolution N] [--steps N] [--speed X]
+ */
+int main(int argc, char** argv)
+{
+    int num_tilings = 8;
+    int resolution = 1023;
+    int steps = 2000000;
+    float speed = 0.5;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--tilings") && i + 1 < argc)
+            num_tilings = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--resolution") && i + 1 < argc)
+            resolution = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--steps") && i + 1 < argc)
+            steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+            speed = atof(argv[++i]);
+    }
+    if (num_tilings < 1 || num_tilings > TiledCMAC2D::max_tilings || resolution < 1 || resolution > 65535)
+    {
+        std::cerr << "--tilings must be in [1, " << TiledCMAC2D::max_tilings << "] and --resolution in [1, 65535]" << std::endl;
+        return 1;
+    }
+    float upperlimit = 2 * PI;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<uint32_t> coordinate(0, 0xffff);
+    for (int i = 0; i < 100000; i++)
+    {
+        uint32_t x = coordinate(rng), y = coordinate(rng);
+        if (mortonEncode(x, y) != mortonEncodeTable(x, y))
+        {
+            std::cerr << "Morton interleave mismatch at " << x << ", " << y << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<float, float>> trajectory = smoothTrajectory(steps, speed, resolution, upperlimit, rng);
+    std::uniform_real_distribution<float> uniform(0, upperlimit);
+    std::vector<std::pair<float, float>> random_points(steps);
+    for (auto& point : random_points)
+        point = { uniform(rng), uniform(rng) };
+
+#ifdef CMAC_MORTON_BMI2
+    const char* interleave = "pdep";
+#else
+    const char* interleave = "table";
+#endif
+    TiledCMAC2D row_major(num_tilings, resolution, 0, upperlimit, LAYOUT_ROW_MAJOR);
+    TiledCMAC2D morton(num_tilings, resolution, 0, upperlimit, LAYOUT_MORTON);
+    std::cout << "Inputs in [0, 2pi)^2, " << num_tilings << " tilings of " << resolution << " x " << resolution << " cells ("
+              << row_major.getWeights().size() * sizeof(float) / 1048576 << " MiB), trajectory speed " << speed << " cells/step"
+              << ", " << interleave << " interleave" << std::endl;
+    std::cout << std::left << std::setw(12) << "layout" << std::setw(12) << "inputs" << std::right << std::setw(14) << "new lines" << std::setw(12) << "ns/step" << std::endl;
+
+    for (auto* points : { &trajectory, &random_points })
+    {
+        const char* name = points == &trajectory ? "trajectory" : "random";
+        for (TiledCMAC2D* model : { &row_major, &morton })
+            std::cout << std::left << std::setw(12) << cellLayoutName(model->getLayout()) << std::setw(12) << name << std::right << std::fixed
+                      << std::setprecision(3) << std::setw(14) << newLinesPerStep(*model, *points)
+                      << std::setprecision(1) << std::setw(12) << controlStepNs(*model, *points) << std::endl;
+    }
+
+    // Same cells in a different place: both layouts must have learned exactly the same function
+    for (auto& point : random_points)
+        if (row_major.predict(point.first, point.second) != morton.predict(point.first, point.second))
+        {
+            std::cerr << "Layouts disagree at " << point.first << ", " << point.second << std::endl;
+            return 1;
+        }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <cstring>
+#include "cmac.h"
+#include "multi_output.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Output k of a smooth synthetic K output function standing in for joint torques
+ *
+ * @param k Output index
+ * @param x Input value
+ * @return Target value
+ */
+float jointTarget(int k, float x)
+{
+    return x * sin((k + 1) * 0.5f * x) + 0.1f * k;
+}
+
+/**
+ * @brief Multi output benchmark entry point
+ * Learns a K output function with K separate CMACs and with one MultiOutputCMAC, checks that both
+ * end with the same weights and reports the time per sample of training and prediction.
+ * Usage: multi_output_benchmark [--variant discrete|continous] [--outputs K] [--gf N] [--weights N] [--points N] [--epochs N]
+ */
+int main(int argc, char** argv)
+{
+    std::string variant = "discrete";
+    int num_outputs = 6;
+    int gen_factor = 16;
+    int num_weights = 1024;
+    int points = 2000;
+    int epochs = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--variant") && i + 1 < argc)
+            variant = argv[++i];
+        else if (!strcmp(argv[i], "--outputs") && i + 1 < argc)
+            num_outputs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--weights") && i + 1 < argc)
+            num_weights = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--points") && i + 1 < argc)
+            points = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--epochs") && i + 1 < argc)
+            epochs = atoi(argv[++i]);
+    }
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+    float lr = 0.05;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uniform(lowerlimit, upperlimit);
+    std::vector<float> inputs(points);
+    std::vector<float> targets(points * num_outputs);
+    for (int i = 0; i < points; i++)
+    {
+        inputs[i] = uniform(rng);
+        for (int k = 0; k < num_outputs; k++)
+            targets[i * num_outputs + k] = jointTarget(k, inputs[i]);
+    }
+
+    // One CMAC per output, each recomputing the active cells
+    std::vector<std::unique_ptr<CMAC>> separate;
+    for (int k = 0; k < num_outputs; k++)
+        separate.push_back(createCMAC(variant, gen_factor, num_weights));
+    auto start = Clock::now();
+    for (int e = 0; e < epochs; e++)
+        for (int i = 0; i < points; i++)
+            for (int k = 0; k < num_outputs; k++)
+                separate[k]->learnSample({ inputs[i], targets[i * num_outputs + k] }, lowerlimit, upperlimit, lr);
+    double separate_train = std::chrono::duration<double>(Clock::now() - start).count();
+
+    MultiOutputCMAC multi(variant, num_outputs, gen_factor, num_weights, lowerlimit, upperlimit);
+    start = Clock::now();
+    for (int e = 0; e < epochs; e++)
+        for (int i = 0; i < points; i++)
+            multi.learn(inputs[i], targets.data() + i * num_outputs, lr);
+    double multi_train = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<float> separate_out(num_outputs), multi_out(num_outputs);
+    volatile float sink = 0;
+    start = Clock::now();
+    for (int i = 0; i < points; i++)
+    {
+        for (int k = 0; k < num_outputs; k++)
+            separate_out[k] = separate[k]->predictPoint(inputs[i], lowerlimit, upperlimit);
+        sink = sink + separate_out[0];
+    }
+    double separate_predict = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (int i = 0; i < points; i++)
+    {
+        multi.predict(inputs[i], multi_out.data());
+        sink = sink + multi_out[0];
+    }
+    double multi_predict = std::chrono::duration<double>(Clock::now() - start).count();
+    (void)sink;
+
+    int mismatches = 0;
+    std::vector<float> weights;
+    for (int k = 0; k < num_outputs; k++)
+    {
+        multi.getBank().exportModel(k, weights);
+        if (!std::equal(weights.begin(), weights.end(), separate[k]->getWtVector().begin(), separate[k]->getWtVector().end()))
+            mismatches++;
+    }
+
+    double train_samples = (double)epochs * points;
+    std::cout << num_outputs << " outputs, " << variant << ", gf " << gen_factor << ", " << num_weights << " cells, loss " << multi.calculateError(inputs, targets) << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::left << std::setw(24) << "" << std::right << std::setw(16) << "train ns/sample" << std::setw(18) << "predict ns/sample" << std::endl;
+    std::cout << std::left << std::setw(24) << "separate CMACs" << std::right << std::setw(16) << separate_train * 1e9 / train_samples << std::setw(18)
+              << separate_predict * 1e9 / points << std::endl;
+    std::cout << std::left << std::setw(24) << "MultiOutputCMAC" << std::right << std::setw(16) << multi_train * 1e9 / train_samples << std::setw(18)
+              << multi_predict * 1e9 / points << std::endl;
+    std::cout << mismatches << " outputs differ from their separate CMAC" << std::endl;
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include "cmac.h"
+
+/**
+ * @brief Per epoch cost of one training order
+ */
+struct OrderResult
+{
+    std::string order;
+    int num_weights;
+    double epoch_ms;            // Median wall time of the update pass of one epoch
+    double update_llc_misses;   // Median LLC misses of the update pass per epoch (-1 without CMAC_PERF_COUNTERS)
+    double update_l1d_misses;   // Median L1D read misses of the update pass per epoch (-1 without CMAC_PERF_COUNTERS)
+    float loss;                 // Training RMSE after the last epoch
+};
+
+/**
+ * @brief Formatter collecting the per epoch time and update pass counters instead of printing them
+ */
+class EpochCollector : public TelemetryFormatter
+{
+public:
+    std::vector<double> epoch_ms;
+    std::vector<double> llc_misses;
+    std::vector<double> l1d_misses;
+    int64_t last_elapsed_ns = 0;
+
+    void write(const EpochRecord& record);
+};
+
+//-----------------------------------------------------------
+
+/**
+ * @brief Record one epoch
+ * @param record Epoch telemetry
+ */
+void EpochCollector::write(const EpochRecord& record)
+{
+    epoch_ms.push_back((record.elapsed_ns - last_elapsed_ns) / 1e6);
+    last_elapsed_ns = record.elapsed_ns;
+#if CMAC_PERF_ENABLED
+    llc_misses.push_back((double)record.phases[PERF_UPDATE].llc_misses);
+    l1d_misses.push_back((double)record.phases[PERF_UPDATE].l1d_misses);
+#endif
+}
+
+/**
+ * @brief Median of a container of samples (-1 if empty)
+ * @param samples Measured values
+ * @return Median value
+ */
+double median(std::vector<double> samples)
+{
+    if (samples.empty())
+        return -1;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    return n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+}
+
+/**
+ * @brief Train a fixed number of epochs in one sample order and collect the per epoch cost
+ *
+ * @param data Training data (random order, as a real dataset would arrive)
+ * @param name Order name for the report
+ * @param mode Shuffle mode
+ * @param gen_factor Generalization Factor of the algorithm
+ * @param num_weights Number of weights allowed
+ * @param epochs Timed epochs (one more is run and discarded as warm-up)
+ * @return Median per epoch cost
+ */
+OrderResult runOrder(const std::vector<std::pair<float, float>>& data, const std::string& name, ShuffleMode mode, int gen_factor, int num_weights, int epochs)
+{
+    EpochCollector* collector = new EpochCollector();
+    TelemetrySink sink(std::unique_ptr<TelemetryFormatter>(collector), epochs + 16);
+
+    DiscreteCMAC model(gen_factor, num_weights);
+    model.setShuffle(mode, 1, 64);
+    model.setTelemetrySink(&sink);
+    // Evaluate only once after the last epoch, so the epoch time is the update pass
+    EarlyStopping no_evaluation;
+    no_evaluation.eval_every = epochs + 1;
+    model.setValidation(Span<std::pair<float, float>>(data.data(), 1), no_evaluation);
+    // A negative threshold never converges, so every order runs the same number of epochs
+    model.train(data, 0, 2 * PI, epochs, 0.1, -1);
+    sink.waitUntilDrained();
+
+    // Drop the warm-up epoch (first touch of the weight table and the association map)
+    if (!collector->epoch_ms.empty())
+        collector->epoch_ms.erase(collector->epoch_ms.begin());
+    if (!collector->llc_misses.empty())
+    {
+        collector->llc_misses.erase(collector->llc_misses.begin());
+        collector->l1d_misses.erase(collector->l1d_misses.begin());
+    }
+    float accuracy = 0;
+    model.predict(data, 0, 2 * PI, accuracy, true);
+    return { name, num_weights, median(collector->epoch_ms), median(collector->llc_misses), median(collector->l1d_misses), 1 - accuracy };
+}
+
+/**
+ * @brief Training order benchmark entry point
+ * Compares the cache behaviour of the sample orders on weight tables from L2 to beyond LLC size.
+ * Usage: order_benchmark [--points N] [--epochs N] [--gf N]
+ */
+int main(int argc, char** argv)
+{
+    int points = 200000;
+    int epochs = 5;
+    int gen_factor = 16;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--points") && i + 1 < argc)
+            points = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--epochs") && i + 1 < argc)
+            epochs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+    }
+
+    std::vector<std::pair<float, float>> data;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uniform(0, 2 * PI);
+    for (int i = 0; i < points; i++)
+    {
+        float x = uniform(rng);
+        data.push_back({ x, x * sin(x) });
+    }
+
+    std::vector<std::pair<std::string, ShuffleMode>> orders = {
+        { "dataset", SHUFFLE_NONE }, { "epoch_shuffle", SHUFFLE_EPOCH }, { "block_shuffle", SHUFFLE_BLOCK },
+        { "sorted", SHUFFLE_SORTED }, { "bucketed", SHUFFLE_BUCKET } };
+
+    if (!CMAC_PERF_ENABLED)
+        std::cerr << "Built without CMAC_PERF_COUNTERS, cache misses are not reported" << std::endl;
+
+    std::cout << std::left << std::setw(16) << "order" << std::setw(12) << "weights" << std::setw(12) << "epoch_ms"
+              << std::setw(16) << "llc_misses" << std::setw(16) << "l1d_misses" << "loss" << std::endl;
+    for (int num_weights : { 1 << 14, 1 << 18, 1 << 22 })
+    {
+        double baseline_ms = 0;
+        for (auto& order : orders)
+        {
+            OrderResult r = runOrder(data, order.first, order.second, gen_factor, num_weights, epochs);
+            if (order.second == SHUFFLE_NONE)
+                baseline_ms = r.epoch_ms;
+            std::cout << std::left << std::setw(16) << r.order << std::setw(12) << r.num_weights << std::setw(12) << r.epoch_ms
+                      << std::setw(16) << r.update_llc_misses << std::setw(16) << r.update_l1d_misses << r.loss
+                      << "  (x" << baseline_ms / r.epoch_ms << " vs dataset order)" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <cstring>
+#include "cmac.h"
+#include "packed_weights.h"
+#include "typed_cmac.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Train a packed model online on x*sin(x) and return its test error
+ *
+ * @param storage Weight storage type
+ * @param rounding Rounding of updated weights
+ * @param train Training samples
+ * @param test Test samples
+ * @param epochs Passes over the training samples
+ * @param lr Learning Rate for training
+ * @return Root mean squared test error
+ */
+float trainAccuracy(WeightStorage storage, RoundingMode rounding, const std::vector<std::pair<float, float>>& train,
+                    const std::vector<std::pair<float, float>>& test, int epochs, float lr)
+{
+    PackedModel model("discrete", 8, 128, 0, 2 * PI, storage, 8, rounding, 1);
+    for (int e = 0; e < epochs; e++)
+        for (auto& sample : train)
+            model.learn(sample, lr);
+    return model.calculateError(test);
+}
+
+/**
+ * @brief Train a typed model until the loss settles and print its epochs, errors and time per sample
+ *
+ * @param name Row label
+ * @param gen_factor Generalization Factor of the model
+ * @param train Training samples
+ * @param test Test samples
+ * @param epochs Maximum number of epochs
+ * @param lr Learning Rate for training
+ */
+template <typename Model>
+void trainTyped(const char* name, int gen_factor, const std::vector<std::pair<float, float>>& train,
+                const std::vector<std::pair<float, float>>& test, int epochs, float lr)
+{
+    Model model("discrete", gen_factor, 2 * gen_factor, 0, 2 * PI);
+    auto start = Clock::now();
+    model.train(train, epochs, lr, 1e-5);
+    // Time per training sample, including the loss evaluated after every epoch
+    double sample_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (model.getEpochsTrained() * train.size());
+    std::cout << std::left << std::setw(16) << name << std::right << std::setw(8) << model.getEpochsTrained() << std::fixed << std::setprecision(5)
+              << std::setw(12) << (double)model.getLoss() << std::setw(12) << (double)model.calculateError(test)
+              << std::setprecision(1) << std::setw(12) << sample_ns << std::endl;
+}
+
+/**
+ * @brief Reduced precision benchmark entry point
+ * Compares every weight storage type against fp32: learning quality on x*sin(x) with nearest
+ * and stochastic rounding, and table footprint and query / update throughput on a large table.
+ * Then trains float and double accumulator models with a wide window on outputs with a large offset.
+ * Usage: precision_benchmark [--weights N] [--gf N] [--queries N] [--epochs N] [--lr X] [--wide-gf N]
+ */
+int main(int argc, char** argv)
+{
+    int num_weights = 1 << 24;
+    int gen_factor = 64;
+    int queries = 2000000;
+    int epochs = 100;
+    float lr = 0.01;
+    int wide_gen_factor = 1024;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--weights") && i + 1 < argc)
+            num_weights = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queries") && i + 1 < argc)
+            queries = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--epochs") && i + 1 < argc)
+            epochs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--lr") && i + 1 < argc)
+            lr = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--wide-gf") && i + 1 < argc)
+            wide_gen_factor = atoi(argv[++i]);
+    }
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+    const WeightStorage storages[] = { STORAGE_FP32, STORAGE_FP16, STORAGE_BF16, STORAGE_INT16 };
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> uniform(lowerlimit, upperlimit);
+    std::vector<std::pair<float, float>> train, test;
+    for (int i = 0; i < 1000; i++)
+    {
+        float x = uniform(rng);
+        (i % 4 ? train : test).push_back({ x, x * sin(x) });
+    }
+
+    std::cout << "Test RMSE on x*sin(x) after " << epochs << " epochs (discrete, gf 8, 128 weights, lr " << lr << ")" << std::endl;
+    std::cout << std::left << std::setw(8) << "storage" << std::right << std::setw(12) << "nearest" << std::setw(12) << "stochastic" << std::endl;
+    for (WeightStorage storage : storages)
+        std::cout << std::left << std::setw(8) << weightStorageName(storage) << std::right << std::fixed << std::setprecision(4)
+                  << std::setw(12) << trainAccuracy(storage, ROUND_NEAREST, train, test, epochs, lr)
+                  << std::setw(12) << trainAccuracy(storage, ROUND_STOCHASTIC, train, test, epochs, lr) << std::endl;
+
+    std::vector<float> inputs(queries);
+    for (float& x : inputs)
+        x = uniform(rng);
+
+    std::cout << std::endl << "Throughput on " << num_weights << " weights, gf " << gen_factor << " (random inputs)" << std::endl;
+    std::cout << std::left << std::setw(8) << "storage" << std::right << std::setw(12) << "MiB" << std::setw(12) << "query ns" << std::setw(12) << "update ns" << std::endl;
+    for (WeightStorage storage : storages)
+    {
+        PackedModel model("discrete", gen_factor, num_weights, lowerlimit, upperlimit, storage, 8, ROUND_STOCHASTIC, 1);
+
+        volatile float sink = 0;
+        auto start = Clock::now();
+        for (int q = 0; q < queries; q++)
+            sink = sink + model.predict(inputs[q]);
+        double query_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queries;
+        (void)sink;
+
+        start = Clock::now();
+        for (int q = 0; q < queries; q++)
+            model.learn({ inputs[q], inputs[q] * sin(inputs[q]) }, lr);
+        double update_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / queries;
+
+        std::cout << std::left << std::setw(8) << weightStorageName(storage) << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << model.getWeights().getBytes() / 1048576.0 << std::setw(12) << query_ns << std::setw(12) << update_ns << std::endl;
+    }
+
+    // A window sum of gen_factor float weights rounds away low bits of a large output, which
+    // limits how far training can reduce the error; a double accumulator removes that floor
+    std::vector<std::pair<float, float>> offset_train, offset_test;
+    for (auto& sample : train)
+        offset_train.push_back({ sample.first, 1000 + sample.second });
+    for (auto& sample : test)
+        offset_test.push_back({ sample.first, 1000 + sample.second });
+
+    std::cout << std::endl << "Training on 1000 + x*sin(x) until the loss settles (discrete, gf " << wide_gen_factor << ", lr 0.5, at most 200 epochs)" << std::endl;
+    std::cout << std::left << std::setw(16) << "weight/acc" << std::right << std::setw(8) << "epochs" << std::setw(12) << "train RMSE"
+              << std::setw(12) << "test RMSE" << std::setw(12) << "ns/sample" << std::endl;
+    trainTyped<FloatCMAC>("float/float", wide_gen_factor, offset_train, offset_test, 200, 0.5);
+    trainTyped<WideAccumulatorCMAC>("float/double", wide_gen_factor, offset_train, offset_test, 200, 0.5);
+    trainTyped<DoubleCMAC>("double/double", wide_gen_factor, offset_train, offset_test, 200, 0.5);
+    return 0;
+}
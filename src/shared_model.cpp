@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstring>
+#include "cmac.h"
+#include "shared_model.h"
+
+/**
+ * @brief Shared model tool entry point
+ * Usage:
+ *   shared_model publish NAME [--variant discrete|continous] [--gf N] [--weights N] [--epochs N] [--model file.bin]
+ *   shared_model query NAME x [x ...]
+ *   shared_model remove NAME
+ * publish trains on the x*sin(x) data (or starts from a saved model) and publishes the weights after every epoch.
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: shared_model publish|query|remove NAME [options]" << std::endl;
+        return 2;
+    }
+    std::string command = argv[1];
+    std::string name = argv[2];
+    float lowerlimit = 0;
+    float upperlimit = 2 * PI;
+
+    if (command == "remove")
+        return SharedModel::remove(name) ? 0 : 1;
+
+    if (command == "query")
+    {
+        std::unique_ptr<SharedModel> shared = SharedModel::open(name);
+        if (!shared)
+            return 1;
+        std::cout << "generation " << shared->getGeneration() / 2 << ", " << shared->getNumWeights() << " weights" << std::endl;
+        bool ok = true;
+        for (int i = 3; i < argc; i++)
+        {
+            float x = atof(argv[i]), y;
+            if (shared->predict(x, y))
+                std::cout << x << " -> " << y << std::endl;
+            else
+            {
+                std::cerr << x << ": no consistent read (input not finite, or a publish never completed)" << std::endl;
+                ok = false;
+            }
+        }
+        return ok ? 0 : 1;
+    }
+
+    std::string variant = "discrete";
+    std::string model_path;
+    int gen_factor = 8;
+    int num_weights = 1024;
+    int epochs = 100;
+    for (int i = 3; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--variant") && i + 1 < argc)
+            variant = argv[++i];
+        else if (!strcmp(argv[i], "--gf") && i + 1 < argc)
+            gen_factor = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--weights") && i + 1 < argc)
+            num_weights = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--epochs") && i + 1 < argc)
+            epochs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--model") && i + 1 < argc)
+            model_path = argv[++i];
+    }
+
+    std::unique_ptr<CMAC> model = model_path.empty() ? createCMAC(variant, gen_factor, num_weights) : loadCMAC(model_path);
+    if (!model)
+    {
+        std::cerr << "could not load " << model_path << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<float, float>> data;
+    for (int i = 0; i < 1000; i++)
+    {
+        float x = i * (upperlimit - lowerlimit) / 1000;
+        data.push_back({ x, x * sin(x) });
+    }
+
+    std::unique_ptr<SharedModel> shared = SharedModel::create(name, *model, lowerlimit, upperlimit);
+    if (!shared)
+        return 1;
+
+    model->setLearningRateSchedule(LearningRateSchedule::automatic());
+    model->setShuffle(SHUFFLE_EPOCH);
+    model->beginTraining(data, lowerlimit, upperlimit);
+    for (int epoch = 0; epoch < epochs && !model->isTrainingFinished(); epoch++)
+    {
+        model->trainEpochs(data, 1, 0.01, 0.00000000001);
+        shared->publish(*model);
+    }
+    std::cout << "published " << name << " after " << model->getEpochsTrained() << " epochs, loss " << model->getLoss()
+              << ", generation " << shared->getGeneration() / 2 << std::endl;
+    return 0;
+}
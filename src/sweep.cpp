@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2022 Paras Savnani (savnani5@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software
+ * is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include "cmac.h"
+#include "sweep.h"
+
+/**
+ * @brief Analysis of Generalization Factors, learning rates and convergence times
+ * Trains the main.cpp dataset for every configuration of the grid in parallel.
+ * Usage: sweep [--halving]   (--halving uses the successive halving scheduler instead of the full grid)
+ */
+int main(int argc, char** argv)
+{
+    bool use_halving = argc > 1 && !strcmp(argv[1], "--halving");
+
+    int points = 100;
+    int num_weights = 35;
+
+    std::vector<std::pair<float, float>> data;
+    {
+        CMAC_TRACE_SCOPE("load data");
+        float increment = 2 * PI / points;
+        for (int i = 0; i < points; i++)
+            data.push_back({ i * increment, (i * increment) * sin(i * increment) });
+
+        // Random shuffling of the data
+        unsigned seed = 0;
+        shuffle(data.begin(), data.end(), std::default_random_engine(seed));
+    }
+
+    std::vector<std::pair<float, float>> train(data.begin(), data.begin() + 70);
+    std::vector<std::pair<float, float>> test(data.begin() + 70, data.end());
+
+    SweepGrid grid;
+    grid.variants = { "discrete", "continous" };
+    for (int gf = 1; gf <= num_weights; gf++)
+        grid.gen_factors.push_back(gf);
+    grid.num_weights = { num_weights };
+    grid.lrs = { 0.001f, 0.01f, 0.1f };
+
+    SweepSettings settings;
+    std::vector<SweepResult> results;
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    if (use_halving)
+        results = SuccessiveHalving(grid, settings, HalvingSettings()).run(train, test);
+    else
+        results = HyperparameterSweep(grid, settings).run(train, test);
+    auto t_end = std::chrono::high_resolution_clock::now();
+
+    HyperparameterSweep::printTable(std::cout, results);
+    std::cout << "Configurations: " << results.size() << " Sweep Time(ms): " << std::chrono::duration<double, std::milli>(t_end - t_start).count() << std::endl;
+
+    // Per worker timeline of the sweep (only recorded when built with CMAC_TRACE)
+    writeChromeTrace("sweep_trace.json");
+}